@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2026 Benjamin Jean-Marie Tremblay
+ *
+ * This file is part of sequence-utils.
+ *
+ * sequence-utils is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * sequence-utils is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with sequence-utils.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Time per draw of std::discrete_distribution (built once, and built for
+ * every draw as the shufflers used to), the alias table and the cumulative
+ * table, for a few alphabet sizes.
+ */
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include "rng.hpp"
+#include "sampler.hpp"
+using namespace std;
+
+using Clock = chrono::high_resolution_clock;
+
+#define NDRAWS 10000000
+
+template <class F>
+double time_draws(F draw, unsigned long n, unsigned long &sink) {
+  auto t0 = Clock::now();
+  for (unsigned long i = 0; i < n; ++i) sink += draw();
+  auto t1 = Clock::now();
+  return chrono::duration_cast<chrono::nanoseconds>(t1 - t0).count() / (double)n;
+}
+
+int main() {
+
+  const unsigned int sizes[] = {2, 4, 20, 64, 256};
+  unsigned long sink{0};
+  xoshiro256ss gen(1);
+
+  printf("%-10s %12s %12s %12s %12s\n", "alphabet", "discrete", "discrete*", "alias",
+      "cumulative");
+
+  for (unsigned int n : sizes) {
+
+    vector<unsigned long> counts(n);
+    for (unsigned int i = 0; i < n; ++i) counts[i] = 1 + gen() % 1000;
+    vector<double> weights(counts.begin(), counts.end());
+
+    discrete_distribution<unsigned int> dd(counts.begin(), counts.end());
+    alias_table alias = make_alias(n);
+    add_distribution(alias, weights);
+    cumulative_table cum = make_cumulative(n);
+    add_distribution(cum, counts.data());
+
+    double t_dd = time_draws([&]() { return dd(gen); }, NDRAWS, sink);
+    double t_rebuild = time_draws([&]() {
+      discrete_distribution<unsigned int> d(counts.begin(), counts.end());
+      return d(gen);
+    }, NDRAWS / 10, sink);
+    double t_alias = time_draws([&]() { return alias.draw(gen); }, NDRAWS, sink);
+    double t_cum = time_draws([&]() { return cum.draw(gen); }, NDRAWS, sink);
+
+    printf("%-10u %10.2fns %10.2fns %10.2fns %10.2fns\n", n, t_dd, t_rebuild, t_alias, t_cum);
+
+  }
+
+  printf("\n(* built for every draw)\n");
+  if (sink == 0) printf("\n");
+
+  return 0;
+
+}
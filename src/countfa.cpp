@@ -19,70 +19,623 @@
  */
 
 #include <iostream>
-#include <fstream>
-#include <unistd.h>
 #include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+#include <thread>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 using namespace std;
 
+#define BLOCK_SIZE 4194304
+
 void usage() {
   printf(
-    "countfa v1.2  Copyright (C) 2019  Benjamin Jean-Marie Tremblay                  \n"
+    "countfa v1.4  Copyright (C) 2019  Benjamin Jean-Marie Tremblay                  \n"
     "                                                                                \n"
     "Usage:  coutfa -i [filename]                                                    \n"
     "        cat [filename] | coutfa                                                 \n"
     "                                                                                \n"
     " -i <str>    Input filename. File must be fasta-formatted. Alternatively, takes \n"
     "             input from a pipe.                                                 \n"
+    " -t <int>    Number of threads. The input file is split into this many parts    \n"
+    "             which are counted in parallel. Only used for regular files given   \n"
+    "             with -i. Defaults to 1.                                            \n"
+    " -x <str>    Also write a samtools-compatible fasta index (.fai) to this file.  \n"
+    "             All lines of a sequence except the last must be of equal length.   \n"
+    " -c          Also print the GC content (as a fraction of non-N characters) and  \n"
+    "             the number of N characters of each sequence, after its length.     \n"
+    " -s <str>    Write summary statistics for the whole file to this file: number of\n"
+    "             sequences, total/min/max/mean length, N50, N90, GC and N content,  \n"
+    "             and a histogram of sequence lengths.                               \n"
     " -h          Print usage and exit.                                              \n"
   );
 }
 
-void do_countfa(istream &input) {
+/* Output is collected and handed over to write() in large blocks. */
+struct out_buffer {
+  int fd;
+  string buf;
+  void flush() {
+    size_t done{0};
+    ssize_t n;
+    while (done < buf.length()) {
+      n = write(fd, buf.data() + done, buf.length() - done);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        cerr << "Error: could not write output\n";
+        exit(EXIT_FAILURE);
+      }
+      done += n;
+    }
+    buf.clear();
+  }
+  void put(const char *p, size_t n) {
+    buf.append(p, n);
+    if (buf.length() >= BLOCK_SIZE) flush();
+  }
+};
+
+struct fa_run {
+  unsigned long bases, width, n;
+};
+
+/* Line layout of a sequence, as needed for a fasta index. Every line but the
+ * last must have the same number of bases and bytes; blank lines are only
+ * allowed at the very end. When recording, lines are kept as runs instead so
+ * that they can be replayed onto the sequence they belong to later on.
+ */
+struct fa_layout {
+  unsigned long offset, length;
+  unsigned long linebases, linewidth;
+  unsigned long curbases, curwidth;
+  bool cr, blank, shorter, bad, recording;
+  vector<fa_run> runs;
+  void reset(unsigned long start, bool record) {
+    offset = start;
+    length = linebases = linewidth = curbases = curwidth = 0;
+    cr = blank = shorter = bad = false;
+    recording = record;
+    runs.clear();
+  }
+  void add_lines(unsigned long bases, unsigned long width, unsigned long n) {
+    if (recording) {
+      if (!runs.empty() && runs.back().bases == bases && runs.back().width == width)
+        runs.back().n += n;
+      else
+        runs.push_back(fa_run{bases, width, n});
+      return;
+    }
+    if (bases == 0) {
+      blank = true;
+      return;
+    }
+    if (blank || shorter) bad = true;
+    if (linewidth == 0) {
+      linebases = bases;
+      linewidth = width;
+    } else if (bases < linebases) {
+      shorter = true;
+    } else if (bases != linebases || width != linewidth) {
+      bad = true;
+    }
+    if (n > 1 && shorter) bad = true;
+    length += bases * n;
+  }
+  void end_line(unsigned long bases, unsigned long width) {
+    /* the newline itself is in width, but a carriage return is not a base */
+    bases += curbases;
+    width += curwidth + 1;
+    if (cr) --bases;
+    add_lines(bases, width, 1);
+    curbases = curwidth = 0;
+    cr = false;
+  }
+  void finish() {
+    /* a last line without a newline only needs to be short enough */
+    if (recording || curwidth == 0) return;
+    if (curbases > 0) {
+      if (blank || shorter || (linewidth > 0 && curbases > linebases)) bad = true;
+      if (linewidth == 0) {
+        linebases = curbases;
+        linewidth = curwidth;
+      }
+      length += curbases;
+      shorter = true;
+    }
+    curbases = curwidth = 0;
+  }
+};
+
+struct fa_state {
+  bool at_name;
+  unsigned long counter, gc, nn;
+  bool index, comp, in_record;
+  fa_layout lay;
+};
+
+/* Whole-file statistics, gathered as records go by. */
+struct fa_summary {
+  bool active;
+  vector<unsigned long> lengths;
+  unsigned long gc, nn;
+};
+
+/* Names and counts go to stdout, and index lines to the index file if one was
+ * requested. Index entries use the name up to the first white space.
+ */
+struct fa_printer {
+  out_buffer &out;
+  out_buffer *fai;
+  fa_summary &summary;
+  bool comp;
+  string faname;
+  bool fai_bad;
+  void name(const char *p, size_t n) {
+    out.put(p, n);
+    if (fai != NULL) faname.append(p, n);
+  }
+  void name_end() { out.put("\n", 1); }
+  void record_end(const fa_state &st) {
+    if (st.counter > 0) {
+      string c = to_string(st.counter);
+      if (comp) {
+        char gc[32];
+        if (st.counter > st.nn)
+          snprintf(gc, sizeof(gc), "\t%.4f\t", (double)st.gc / (st.counter - st.nn));
+        else
+          snprintf(gc, sizeof(gc), "\tNA\t");
+        c += gc + to_string(st.nn);
+      }
+      c += '\n';
+      out.put(c.data(), c.length());
+    }
+    if (summary.active && st.in_record) {
+      summary.lengths.push_back(st.counter);
+      summary.gc += st.gc;
+      summary.nn += st.nn;
+    }
+    if (fai == NULL || !st.in_record) return;
+    size_t namelen{1};
+    while (namelen < faname.length() && !isspace((unsigned char)faname[namelen]))
+      ++namelen;
+    if (st.lay.bad && !fai_bad) {
+      cerr << "Warning: no index written, lines of uneven length in sequence ["
+        << faname.substr(1, namelen - 1) << "]\n";
+      fai_bad = true;
+    }
+    if (!fai_bad) {
+      string line = faname.substr(1, namelen - 1) + '\t' + to_string(st.lay.length)
+        + '\t' + to_string(st.lay.offset) + '\t' + to_string(st.lay.linebases)
+        + '\t' + to_string(st.lay.linewidth) + '\n';
+      fai->put(line.data(), line.length());
+    }
+    faname.clear();
+  }
+};
+
+size_t count_bases(const char *p, size_t n) {
+
+  /* Everything but spaces and newlines is counted. The inner loop uses a byte
+   * sized accumulator so that it can be vectorised; it is emptied every 255
+   * characters before it can overflow.
+   */
+
+  size_t ws{0}, m, len{n};
+  unsigned char acc;
+
+  while (n > 0) {
+    m = min(n, (size_t)255);
+    acc = 0;
+    for (size_t i = 0; i < m; ++i) {
+      acc += (p[i] == ' ') | (p[i] == '\n');
+    }
+    ws += acc;
+    p += m;
+    n -= m;
+  }
+
+  return len - ws;
+
+}
+
+void count_composition(const char *p, size_t n, unsigned long &gc, unsigned long &nn) {
+
+  /* G/C and N, in either case; like count_bases() this is vectorised with
+   * byte sized accumulators
+   */
+
+  size_t m;
+  unsigned char acc_gc, acc_n, l;
+
+  while (n > 0) {
+    m = min(n, (size_t)255);
+    acc_gc = 0;
+    acc_n = 0;
+    for (size_t i = 0; i < m; ++i) {
+      l = p[i] | 0x20;
+      acc_gc += (l == 'g') | (l == 'c');
+      acc_n += l == 'n';
+    }
+    gc += acc_gc;
+    nn += acc_n;
+    p += m;
+    n -= m;
+  }
+
+}
+
+inline void count_span(const char *p, size_t n, fa_state &st) {
+  st.counter += count_bases(p, n);
+  if (st.comp) count_composition(p, n, st.gc, st.nn);
+}
+
+void count_lines(const char *p, const char *end, fa_state &st) {
+
+  /* same counting as count_bases(), but one line at a time */
+
+  const char *next;
+  size_t bases;
+
+  while (p < end) {
+    next = (const char *)memchr(p, '\n', end - p);
+    if (next == NULL) {
+      bases = count_bases(p, end - p);
+      st.counter += bases;
+      if (st.comp) count_composition(p, end - p, st.gc, st.nn);
+      st.lay.curbases += bases;
+      st.lay.curwidth += end - p;
+      st.lay.cr = end[-1] == '\r';
+      return;
+    }
+    bases = count_bases(p, next - p);
+    st.counter += bases;
+    if (st.comp) count_composition(p, next - p, st.gc, st.nn);
+    if (next > p) st.lay.cr = next[-1] == '\r';
+    st.lay.end_line(bases, next - p);
+    p = next + 1;
+  }
+
+}
+
+/* Records found by one thread in its part of the file. Names point into the
+ * mapped file. The counts before the first name belong to a record started in
+ * an earlier part, and the count of the last record may continue into a later
+ * one; these are stitched together when the parts are merged, as are the
+ * sequence lines needed for the index.
+ */
+struct fa_record {
+  const char *name;
+  size_t namelen;
+  bool name_end;
+  fa_state st;
+};
+
+struct fa_chunk {
+  fa_state lead;
+  vector<fa_record> records;
+  fa_state st;
+};
+
+struct fa_recorder {
+  fa_chunk &chunk;
+  void name(const char *p, size_t n) {
+    fa_record &r = chunk.records.back();
+    if (r.namelen == 0) r.name = p;
+    r.namelen += n;
+  }
+  void name_end() { chunk.records.back().name_end = true; }
+  void record_end(const fa_state &st) {
+    if (chunk.records.empty()) chunk.lead = st;
+    else chunk.records.back().st = st;
+    chunk.records.push_back(fa_record());
+    chunk.records.back().namelen = 0;
+    chunk.records.back().name_end = false;
+  }
+};
+
+template <class Sink>
+void scan_fasta(const char *begin, const char *end, unsigned long base, fa_state &st,
+    Sink &sink) {
+
+  /* Names are copied up to the next newline, and sequences are counted up to
+   * the next '>', with memchr() doing the searching. A name or sequence which
+   * runs past the end of the block is picked up again from the saved state.
+   * base is the offset of the block within the input.
+   */
+
+  const char *p{begin}, *next;
+
+  while (p < end) {
+
+    if (st.at_name) {
+
+      next = (const char *)memchr(p, '\n', end - p);
+      if (next == NULL) {
+        sink.name(p, end - p);
+        return;
+      }
+      sink.name(p, next - p);
+      sink.name_end();
+      st.at_name = false;
+      st.in_record = true;
+      if (st.index) st.lay.reset(base + (next + 1 - begin), false);
+      p = next + 1;
 
-  bool at_name{false};
-  unsigned long counter{0};
-  char l;
+    } else {
 
-  while (input.get(l)) {
+      next = (const char *)memchr(p, '>', end - p);
+      if (next == NULL) {
+        if (st.index) count_lines(p, end, st);
+        else count_span(p, end - p, st);
+        return;
+      }
+      if (st.index) {
+        count_lines(p, next, st);
+        st.lay.finish();
+      } else {
+        count_span(p, next - p, st);
+      }
+      sink.record_end(st);
+      st.counter = st.gc = st.nn = 0;
+      st.at_name = true;
+      st.in_record = false;
+      p = next;
 
-    if (l == '>') {
-      if (counter > 0) cout << counter << '\n';
-      at_name = true;
-      counter = 0;
     }
 
-    if (l == '\n' && at_name) {
-      at_name = false;
-      cout << '\n';
+  }
+
+}
+
+void init_state(fa_state &st, bool index, bool comp, bool record) {
+  st.at_name = false;
+  st.counter = st.gc = st.nn = 0;
+  st.index = index;
+  st.comp = comp;
+  st.in_record = false;
+  st.lay.reset(0, record);
+}
+
+void close_index(out_buffer *fai, const char *filename, bool bad) {
+
+  if (fai == NULL) return;
+
+  if (bad) {
+    close(fai->fd);
+    unlink(filename);
+  } else {
+    fai->flush();
+    close(fai->fd);
+  }
+
+}
+
+void do_countfa(int input, out_buffer *fai, const char *fainame, bool comp,
+    fa_summary &summary) {
+
+  vector<char> block(BLOCK_SIZE);
+  out_buffer out{STDOUT_FILENO, string()};
+  fa_printer printer{out, fai, summary, comp, string(), false};
+  fa_state st;
+  unsigned long base{0};
+  ssize_t n;
+
+  init_state(st, fai != NULL, comp || summary.active, false);
+
+  while ((n = read(input, block.data(), BLOCK_SIZE)) != 0) {
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      cerr << "Error: could not read input\n";
+      exit(EXIT_FAILURE);
     }
+    scan_fasta(block.data(), block.data() + n, base, st, printer);
+    base += n;
+  }
+
+  if (!st.at_name) {
+    st.lay.finish();
+    printer.record_end(st);
+  }
+
+  out.flush();
+  close_index(fai, fainame, printer.fai_bad);
+
+  return;
+
+}
+
+void do_countfa_parallel(int input, size_t filesize, unsigned int nthreads,
+    out_buffer *fai, const char *fainame, bool comp, fa_summary &summary) {
+
+  const char *map, *end;
+  vector<const char *> bounds;
+  vector<fa_chunk> chunks(nthreads);
+  vector<thread> threads;
+  out_buffer out{STDOUT_FILENO, string()};
+  fa_printer printer{out, fai, summary, comp, string(), false};
+  fa_state st;
+
+  map = (const char *)mmap(NULL, filesize, PROT_READ, MAP_PRIVATE, input, 0);
+  if (map == MAP_FAILED) {
+    cerr << "Error: could not map input file\n";
+    exit(EXIT_FAILURE);
+  }
+  end = map + filesize;
+
+  /* parts start at the beginning of a line, where we can't be inside a name */
+  bounds.push_back(map);
+  for (unsigned int i = 1; i < nthreads; ++i) {
+    const char *b = max(map + filesize / nthreads * i, bounds.back());
+    b = (const char *)memchr(b, '\n', end - b);
+    bounds.push_back(b == NULL ? end : b + 1);
+  }
+  bounds.push_back(end);
+
+  for (unsigned int i = 0; i < nthreads; ++i) {
+    threads.push_back(thread([&chunks, &bounds, map, fai, &summary, comp, i]() {
+      fa_chunk &chunk = chunks[i];
+      fa_recorder recorder{chunk};
+      init_state(chunk.st, fai != NULL, comp || summary.active, true);
+      scan_fasta(bounds[i], bounds[i + 1], bounds[i] - map, chunk.st, recorder);
+      if (chunk.records.empty()) chunk.lead = chunk.st;
+    }));
+  }
+  for (unsigned int i = 0; i < nthreads; ++i) threads[i].join();
 
-    if (at_name) cout << l;
-    else if (l != ' ' && l != '\n') ++counter;
+  /* replay the parts in order, as if they had been read in a single pass */
 
+  init_state(st, fai != NULL, comp || summary.active, false);
+
+  for (unsigned int i = 0; i < nthreads; ++i) {
+    const fa_chunk &chunk = chunks[i];
+    const fa_layout &lead = chunk.lead.lay;
+    st.counter += chunk.lead.counter;
+    st.gc += chunk.lead.gc;
+    st.nn += chunk.lead.nn;
+    for (size_t j = 0; j < lead.runs.size() && st.index; ++j) {
+      st.lay.add_lines(lead.runs[j].bases, lead.runs[j].width, lead.runs[j].n);
+    }
+    if (st.index) {
+      st.lay.curbases += lead.curbases;
+      st.lay.curwidth += lead.curwidth;
+      if (lead.curwidth > 0) st.lay.cr = lead.cr;
+    }
+    if (chunk.records.empty()) continue;
+    st.lay.finish();
+    printer.record_end(st);
+    for (size_t j = 0; j < chunk.records.size(); ++j) {
+      const fa_record &r = chunk.records[j];
+      if (r.namelen > 0) printer.name(r.name, r.namelen);
+      if (r.name_end) printer.name_end();
+      if (j + 1 < chunk.records.size()) printer.record_end(r.st);
+    }
+    st = chunk.st;
   }
 
-  if (!at_name && counter > 0) cout << counter << '\n';
+  if (!st.at_name) {
+    st.lay.finish();
+    printer.record_end(st);
+  }
+
+  out.flush();
+  close_index(fai, fainame, printer.fai_bad);
+  munmap((void *)map, filesize);
 
   return;
 
 }
 
+void write_summary(fa_summary &summary, out_buffer &out) {
+
+  /* Nx is the length of the shortest sequence among the longest ones which
+   * together make up x% of the total length
+   */
+
+  vector<unsigned long> &lengths = summary.lengths;
+  vector<unsigned long> hist;
+  unsigned long total{0}, cumsum{0}, n50{0}, n90{0}, l50{0}, l90{0}, bin;
+  char line[128];
+  string res;
+
+  sort(lengths.begin(), lengths.end(), greater<unsigned long>());
+  for (size_t i = 0; i < lengths.size(); ++i) total += lengths[i];
+  for (size_t i = 0; i < lengths.size(); ++i) {
+    cumsum += lengths[i];
+    if (l50 == 0 && cumsum * 2 >= total) {
+      n50 = lengths[i];
+      l50 = i + 1;
+    }
+    if (l90 == 0 && cumsum * 10 >= total * 9) {
+      n90 = lengths[i];
+      l90 = i + 1;
+    }
+    bin = 0;
+    for (unsigned long x = lengths[i]; x >= 10; x /= 10) ++bin;
+    if (bin >= hist.size()) hist.resize(bin + 1, 0);
+    ++hist[bin];
+  }
+
+  res += "sequences\t" + to_string(lengths.size()) + '\n';
+  res += "total_length\t" + to_string(total) + '\n';
+  res += "min_length\t" + to_string(lengths.empty() ? 0 : lengths.back()) + '\n';
+  res += "max_length\t" + to_string(lengths.empty() ? 0 : lengths.front()) + '\n';
+  snprintf(line, sizeof(line), "mean_length\t%.2f\n",
+      lengths.empty() ? 0.0 : (double)total / lengths.size());
+  res += line;
+  res += "N50\t" + to_string(n50) + '\n';
+  res += "L50\t" + to_string(l50) + '\n';
+  res += "N90\t" + to_string(n90) + '\n';
+  res += "L90\t" + to_string(l90) + '\n';
+  if (total > summary.nn)
+    snprintf(line, sizeof(line), "GC\t%.4f\n", (double)summary.gc / (total - summary.nn));
+  else
+    snprintf(line, sizeof(line), "GC\tNA\n");
+  res += line;
+  res += "N\t" + to_string(summary.nn) + '\n';
+  for (size_t i = 0; i < hist.size(); ++i) {
+    if (i == 0)
+      res += "length_0-9\t" + to_string(hist[i]) + '\n';
+    else
+      res += "length_1" + string(i, '0') + "-" + string(i + 1, '9') + '\t'
+        + to_string(hist[i]) + '\n';
+  }
+
+  out.put(res.data(), res.length());
+  out.flush();
+  close(out.fd);
+
+}
+
 int main(int argc, char **argv) {
 
-  int opt;
-  bool has_file{false};
-  ifstream seqfile;
+  int opt, nthreads{1};
+  int seqfile{-1};
+  struct stat sb;
+  out_buffer fai{-1, string()}, sumfile{-1, string()};
+  const char *fainame{NULL};
+  bool comp{false};
+  fa_summary summary{false, vector<unsigned long>(), 0, 0};
 
-  while ((opt = getopt(argc, argv, "i:h")) != -1) {
+  while ((opt = getopt(argc, argv, "i:t:x:cs:h")) != -1) {
     switch (opt) {
       case 'i': if (optarg) {
-                  seqfile.open(optarg);
-                  if (seqfile.bad()) {
+                  seqfile = open(optarg, O_RDONLY);
+                  if (seqfile < 0) {
                     cerr << "Error: file not found\n";
                     cerr << "Run countfa -h to see usage.\n";
                     exit(EXIT_FAILURE);
                   }
-                  has_file = true;
+                }
+                break;
+      case 't': if (optarg) nthreads = atoi(optarg);
+                break;
+      case 'x': if (optarg) {
+                  fai.fd = open(optarg, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                  if (fai.fd < 0) {
+                    cerr << "Error: could not create index file\n";
+                    cerr << "Run countfa -h to see usage.\n";
+                    exit(EXIT_FAILURE);
+                  }
+                  fainame = optarg;
+                }
+                break;
+      case 'c': comp = true;
+                break;
+      case 's': if (optarg) {
+                  sumfile.fd = open(optarg, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                  if (sumfile.fd < 0) {
+                    cerr << "Error: could not create summary file\n";
+                    cerr << "Run countfa -h to see usage.\n";
+                    exit(EXIT_FAILURE);
+                  }
+                  summary.active = true;
                 }
                 break;
       case 'h': usage();
@@ -90,17 +643,32 @@ int main(int argc, char **argv) {
     }
   }
 
-  if (!has_file) {
+  if (nthreads < 1) {
+    cerr << "Error: number of threads must be greater than 0\n";
+    cerr << "Run countfa -h to see usage.\n";
+    exit(EXIT_FAILURE);
+  }
+
+  if (seqfile < 0) {
     if (isatty(STDIN_FILENO)) {
       cerr << "Error: missing input\n";
       cerr << "Run countfa -h to see usage.\n";
       exit(EXIT_FAILURE);
     }
-    do_countfa(cin);
+    do_countfa(STDIN_FILENO, fainame ? &fai : NULL, fainame, comp, summary);
+  } else if (nthreads > 1 && fstat(seqfile, &sb) == 0 && S_ISREG(sb.st_mode)
+      && sb.st_size > 0) {
+    do_countfa_parallel(seqfile, sb.st_size, nthreads, fainame ? &fai : NULL, fainame,
+        comp, summary);
+    close(seqfile);
   } else {
-    do_countfa(seqfile);
+    posix_fadvise(seqfile, 0, 0, POSIX_FADV_SEQUENTIAL);
+    do_countfa(seqfile, fainame ? &fai : NULL, fainame, comp, summary);
+    close(seqfile);
   }
 
+  if (summary.active) write_summary(summary, sumfile);
+
   return 0;
 
 }
@@ -26,18 +26,22 @@
 #include <set>
 #include <unistd.h>
 #include <unordered_map>
+#include <memory>
 #include "klets.hpp"
+#include "twobit.hpp"
 using namespace std;
 
 void usage() {
   printf(
-    "countlets v1.3  Copyright (C) 2019  Benjamin Jean-Marie Tremblay                \n"
+    "countlets v1.4  Copyright (C) 2019  Benjamin Jean-Marie Tremblay                \n"
     "                                                                                \n"
     "Usage:  countlets [options] -i [filename] -o [filename]                         \n"
     "        echo [string] | countlets [options] > [filename]                        \n"
     "                                                                                \n"
     " -i <str>   Input filename. All white space will be removed. Alternatively, can \n"
-    "            take string input from a pipe.                                      \n"
+    "            take string input from a pipe. UCSC .2bit files are also accepted.  \n"
+    " -r <str>   Name of the sequence to read from a .2bit file. Not needed if the   \n"
+    "            file only has one sequence.                                         \n"
     " -o <str>   Output filename. Alternatively, prints to stdout. Output is in tsv  \n"
     "            format.                                                             \n"
     " -a <str>   A string containing all of the alphabet letters present in the      \n"
@@ -93,9 +97,12 @@ int main(int argc, char **argv) {
   set<unsigned int> lets_set;
   vector<char> lets_uniq;
   vector<string> klets;
-  string alph;
+  string alph, seqname, filename;
+  twobit_file tb;
+  unique_ptr<twobit_buf> tbbuf;
+  istream tbin(NULL);
 
-  while ((opt = getopt(argc, argv, "i:k:o:a:nh")) != -1) {
+  while ((opt = getopt(argc, argv, "i:k:o:a:r:nh")) != -1) {
     switch (opt) {
 
       case 'i': if (optarg) {
@@ -106,9 +113,13 @@ int main(int argc, char **argv) {
                     exit(EXIT_FAILURE);
                   }
                   has_file = true;
+                  filename = optarg;
                 }
                 break;
 
+      case 'r': if (optarg) seqname = optarg;
+                break;
+
       case 'k': if (optarg) k = atoi(optarg);
                 break;
 
@@ -150,6 +161,21 @@ int main(int argc, char **argv) {
     }
   }
 
+  /* .2bit input is decoded on the fly */
+
+  if (has_file && is_twobit(filename.c_str())) {
+    seqfile.close();
+    tb = twobit_open(filename.c_str());
+    tbbuf.reset(new twobit_buf(tb, twobit_find(tb, seqname)));
+    tbin.rdbuf(tbbuf.get());
+  } else if (!seqname.empty()) {
+    cerr << "Error: -r is only used with .2bit input\n";
+    cerr << "Run countlets -h to see usage.\n";
+    exit(EXIT_FAILURE);
+  }
+
+  istream &input = tbbuf ? tbin : has_file ? seqfile : cin;
+
   /* read input */
 
   if (!has_alph) {
@@ -161,12 +187,7 @@ int main(int argc, char **argv) {
     size_t seqlen;
     char l;
 
-    if (!has_file) {
-      while (cin >> l) letters += l;
-    } else {
-      while (seqfile >> l) letters += l;
-      seqfile.close();
-    }
+    while (input >> l) letters += l;
 
     /* make and count klets */
 
@@ -215,12 +236,7 @@ int main(int argc, char **argv) {
 
     klets = make_klets(lets_uniq, k);
 
-    if (!has_file) {
-      counts = count_stream(cin, klets, k);
-    } else {
-      counts = count_stream(seqfile, klets, k);
-      seqfile.close();
-    }
+    counts = count_stream(input, klets, k);
 
     /* return */
 
@@ -242,6 +258,9 @@ int main(int argc, char **argv) {
 
   }
 
+  if (has_file) seqfile.close();
+  if (tbbuf) twobit_close(tb);
+
   return 0;
 
 }
@@ -21,83 +21,469 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <deque>
 #include <string>
 #include <set>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
 #include <unistd.h>
+#include <getopt.h>
+#include <memory>
 #include "klets.hpp"
+#include "twobit.hpp"
 using namespace std;
 
+#define BUFFER_SIZE 1048576
+
 void usage() {
   printf(
-    "countwin v1.1  Copyright (C) 2019  Benjamin Jean-Marie Tremblay                 \n"
+    "countwin v1.3  Copyright (C) 2019  Benjamin Jean-Marie Tremblay                 \n"
     "                                                                                \n"
     "Usage:   countwin [options] -a [alphabet] -i [filename] -o [filename]           \n"
     "         echo [string] | countwin [options] -a [alphabet] > [filename]          \n"
     "                                                                                \n"
     " -i <str>   Input filename. All white space will be ignore. Alternatively, can  \n"
-    "            take string input from a pipe.                                      \n"
+    "            take string input from a pipe. UCSC .2bit files are also accepted.  \n"
+    " -r <str>   Name of the sequence to read from a .2bit file. Not needed if the   \n"
+    "            file only has one sequence.                                         \n"
     " -o <str>   Output filename. Alternatively, prints to stdout. Output is printed \n"
     "            in tsv format.                                                      \n"
     " -a <str>   A string containing all of the alphabet letters present in the      \n"
     "            sequence.                                                           \n"
-    " -k <int>   K-let size. Defaults to 1.                                          \n"
-    " -w <int>   Window size. Defaults to K.                                         \n"
+    " -k <int>   K-let size. Defaults to 1. Multiple comma-separated values can be   \n"
+    "            provided, in which case every window is counted for each k.         \n"
+    " -w <int>   Window size. Defaults to K. Multiple comma-separated values can be  \n"
+    "            provided to count several window sizes in a single pass.            \n"
     " -s <int>   Step size. Must be equal to or less than window size. Defaults to   \n"
+    "            window size. Either a single value for all windows, or one value per\n"
     "            window size.                                                        \n"
     " -n         Don't print rows where the COUNT column is 0.                       \n"
+    " --stat <str>                                                                   \n"
+    "            Instead of k-let counts, print a single row per window with the     \n"
+    "            requested comma-separated summaries. Available: gc (fraction of G   \n"
+    "            and C letters), cpg (CpG observed/expected ratio), entropy (Shannon \n"
+    "            entropy of the k-lets, in bits) and kl (Kullback-Leibler divergence \n"
+    "            of the k-lets from those of the whole sequence, in bits; requires   \n"
+    "            -i).                                                                \n"
     " -h         Show usage.                                                         \n"
+    "                                                                                \n"
+    "When more than one combination of window, step and k is requested, the columns  \n"
+    "WINDOW, STEP and K are added to the output to identify each track.              \n"
   );
 }
 
-string make_row(string START, string STOP, const vector<unsigned long> &counts,
-    const vector<string> &klets, bool nozero) {
+/* A rolling k-let index over the input, shared by all tracks with the same k.
+ * The ring holds the k-let indices of the most recent positions (by start
+ * position), so that tracks can drop k-lets once they leave their windows.
+ */
+struct klet_stream {
+  unsigned int k;
+  unsigned long nletsm1;
+  unsigned long current;
+  vector<unsigned long> ring;
+  vector<string> klets;
+  vector<double> log2q;
+};
 
-  string out;
+struct klet_counter {
+  size_t stream;
+  vector<unsigned long> counts;
+};
 
-  for (size_t i = 0; i < counts.size(); ++i) {
-    if (counts[i] > 0 || !nozero)
-      out += START + '\t' + STOP + '\t' + klets[i] + '\t' + to_string(counts[i]) + '\n';
+/* A single (window, step, k) combination. Most tracks are rolling: k-lets are
+ * added as they come in and removed as the window slides past them. Tracks
+ * whose windows are made up of whole windows of a smaller tiling track with
+ * the same k are instead aggregated from those tiles when they are complete.
+ *
+ * The first counter holds the k-lets of the track. With --stat, counters for
+ * single letters and 2-lets may follow (mono, di), and the sums needed for
+ * entropy and divergence are kept up to date as k-lets come and go.
+ */
+struct track {
+  unsigned long window, step;
+  unsigned int k;
+  long source;
+  unsigned long START;
+  vector<klet_counter> counters;
+  int mono, di;
+  double slogs, qlogs;
+  deque<pair<unsigned long, vector<unsigned long>>> tiles;
+  vector<size_t> sinks;
+  string prefix;
+};
+
+enum { STAT_GC, STAT_CPG, STAT_ENTROPY, STAT_KL };
+
+struct stat_setup {
+  vector<int> stats;
+  bool logs;
+  vector<unsigned long> gc_i;
+  unsigned long c_i, g_i;
+  vector<unsigned long> cg_i;
+  vector<double> dxlogx;
+};
+
+vector<unsigned long> parse_list(const string &opt, char flag) {
+
+  vector<unsigned long> out;
+  size_t last{0}, next{0};
+  long val;
+  string item;
+
+  while (true) {
+    next = opt.find(',', last);
+    item = opt.substr(last, next == string::npos ? string::npos : next - last);
+    val = atol(item.c_str());
+    if (item.empty() || val < 1) {
+      cerr << "Error: could not parse -" << flag << " option\n";
+      cerr << "Run countwin -h to see usage.\n";
+      exit(EXIT_FAILURE);
+    }
+    out.push_back(val);
+    if (next == string::npos) break;
+    last = next + 1;
   }
 
   return out;
 
 }
 
-string extract_window(istream &input, unsigned long window) {
+void write_counts(string &out, const track &t, const vector<unsigned long> &counts,
+    const vector<string> &klets, unsigned long START, unsigned long STOP, bool nozero) {
+
+  string pos = t.prefix + to_string(START) + '\t' + to_string(STOP) + '\t';
+
+  for (size_t i = 0; i < counts.size(); ++i) {
+    if (counts[i] > 0 || !nozero) {
+      out += pos;
+      out += klets[i];
+      out += '\t';
+      out += to_string(counts[i]);
+      out += '\n';
+    }
+  }
+
+}
+
+void write_stats(string &out, const track &t, const stat_setup &st,
+    unsigned long START, unsigned long STOP) {
+
+  char num[32];
+  double T, gc, c, g;
+  unsigned long len = STOP - START + 1;
+
+  out += t.prefix + to_string(START) + '\t' + to_string(STOP);
+
+  for (size_t i = 0; i < st.stats.size(); ++i) {
+
+    const vector<unsigned long> &mono = t.mono >= 0 ? t.counters[t.mono].counts
+      : t.counters[0].counts;
+    T = len - t.k + 1;
+    num[0] = '\0';
+
+    switch (st.stats[i]) {
+
+      case STAT_GC: gc = 0;
+                    for (size_t j = 0; j < st.gc_i.size(); ++j) {
+                      gc += mono[st.gc_i[j]];
+                    }
+                    snprintf(num, sizeof(num), "%.6f", gc / len);
+                    break;
+
+      case STAT_CPG: gc = 0;
+                     for (size_t j = 0; j < st.cg_i.size(); ++j) {
+                       gc += t.counters[t.di].counts[st.cg_i[j]];
+                     }
+                     c = mono[st.c_i];
+                     g = mono[st.g_i];
+                     if (c > 0 && g > 0)
+                       snprintf(num, sizeof(num), "%.6f", gc * len / (c * g));
+                     else
+                       snprintf(num, sizeof(num), "NA");
+                     break;
+
+      case STAT_ENTROPY: snprintf(num, sizeof(num), "%.6f",
+                             max(0.0, log2(T) - t.slogs / T));
+                         break;
+
+      case STAT_KL: snprintf(num, sizeof(num), "%.6f",
+                        max(0.0, (t.slogs - t.qlogs) / T - log2(T)));
+                    break;
+
+    }
+
+    out += '\t';
+    out += num;
+
+  }
+
+  out += '\n';
+
+}
+
+inline void add_klet(track &t, size_t ci, unsigned long let, const klet_stream &s,
+    const stat_setup &st) {
+
+  unsigned long &c = t.counters[ci].counts[let];
+
+  if (ci == 0 && st.logs) {
+    t.slogs += st.dxlogx[c];
+    if (!s.log2q.empty()) t.qlogs += s.log2q[let];
+  }
+  ++c;
+
+}
+
+inline void drop_klet(track &t, size_t ci, unsigned long let, const klet_stream &s,
+    const stat_setup &st) {
+
+  unsigned long &c = t.counters[ci].counts[let];
+
+  --c;
+  if (ci == 0 && st.logs) {
+    t.slogs -= st.dxlogx[c];
+    if (!s.log2q.empty()) t.qlogs -= s.log2q[let];
+  }
+
+}
+
+void emit_rolling(track &t, vector<track> &tracks, const vector<klet_stream> &streams,
+    const stat_setup &st, unsigned long STOP, string &out, bool nozero) {
+
+  unsigned long last;
+
+  if (st.stats.empty()) {
+    write_counts(out, t, t.counters[0].counts, streams[t.counters[0].stream].klets,
+        t.START, STOP, nozero);
+  } else {
+    write_stats(out, t, st, t.START, STOP);
+  }
+
+  for (size_t i = 0; i < t.sinks.size(); ++i) {
+    tracks[t.sinks[i]].tiles.push_back(make_pair(t.START, t.counters[0].counts));
+  }
+
+  /* drop the k-lets which start before the next window */
+  for (size_t i = 0; i < t.counters.size(); ++i) {
+    const klet_stream &s = streams[t.counters[i].stream];
+    last = min(t.START + t.step - 1, STOP - s.k + 1);
+    for (unsigned long q = t.START; q <= last; ++q) {
+      drop_klet(t, i, s.ring[q % s.ring.size()], s, st);
+    }
+  }
+
+  t.START += t.step;
+
+}
+
+void emit_aggregate(track &t, const vector<track> &tracks, const klet_stream &s,
+    unsigned long STOP, string &out, bool nozero) {
+
+  unsigned long tile = tracks[t.source].window;
+  size_t ringlen = s.ring.size();
+  vector<unsigned long> &counts = t.counters[0].counts;
+
+  fill(counts.begin(), counts.end(), 0);
+
+  for (size_t i = 0; i < t.tiles.size(); ++i) {
+    for (size_t j = 0; j < counts.size(); ++j) {
+      counts[j] += t.tiles[i].second[j];
+    }
+  }
+
+  /* the tiles are missing the k-lets which straddle their edges */
+  for (unsigned long b = t.START + tile; b <= STOP; b += tile) {
+    for (unsigned long q = b - t.k + 1; q < b && q + t.k - 1 <= STOP; ++q) {
+      ++counts[s.ring[q % ringlen]];
+    }
+  }
+
+  write_counts(out, t, counts, s.klets, t.START, STOP, nozero);
+
+  t.START += t.step;
+  while (!t.tiles.empty() && t.tiles.front().first < t.START) {
+    t.tiles.pop_front();
+  }
+
+}
+
+template <class F>
+unsigned long read_letters(istream &input, const vector<unsigned int> &let2int, F each) {
+
+  vector<char> buf(BUFFER_SIZE);
+  unsigned long p{0};
+  size_t n;
+
+  while (input.read(buf.data(), BUFFER_SIZE) || input.gcount() > 0) {
+    n = input.gcount();
+    for (size_t i = 0; i < n; ++i) {
+      if (isspace((unsigned char)buf[i])) continue;
+      each(++p, let2int[(unsigned char)buf[i]]);
+    }
+  }
+
+  return p;
+
+}
+
+void count_profile(istream &input, vector<klet_stream> &streams,
+    const vector<unsigned int> &let2int, size_t alphlen) {
+
+  /* whole-sequence k-let frequencies, used as the background for kl */
+
+  vector<vector<unsigned long>> counts(streams.size());
+  vector<unsigned long> current(streams.size(), 0);
+
+  for (size_t i = 0; i < streams.size(); ++i) {
+    counts[i].assign(streams[i].klets.size(), 0);
+  }
+
+  read_letters(input, let2int, [&](unsigned long p, unsigned int l) {
+    for (size_t i = 0; i < streams.size(); ++i) {
+      current[i] = (current[i] % streams[i].nletsm1) * alphlen + l;
+      if (p >= streams[i].k) ++counts[i][current[i]];
+    }
+  });
+
+  for (size_t i = 0; i < streams.size(); ++i) {
+    double total{0};
+    for (size_t j = 0; j < counts[i].size(); ++j) total += counts[i][j];
+    streams[i].log2q.assign(counts[i].size(), 0);
+    for (size_t j = 0; j < counts[i].size(); ++j) {
+      if (counts[i][j] > 0) streams[i].log2q[j] = log2(counts[i][j] / total);
+    }
+  }
+
+}
+
+void count_windows(istream &input, ostream &output, vector<track> &tracks,
+    vector<klet_stream> &streams, const stat_setup &st,
+    const vector<unsigned int> &let2int, size_t alphlen, unsigned int mink,
+    bool nozero) {
 
+  unsigned long seqlen;
   string out;
-  char l;
-  unsigned long counter{0};
-  out.reserve(window);
+  out.reserve(BUFFER_SIZE);
+
+  seqlen = read_letters(input, let2int, [&](unsigned long p, unsigned int l) {
+
+    for (size_t j = 0; j < streams.size(); ++j) {
+      klet_stream &s = streams[j];
+      s.current = (s.current % s.nletsm1) * alphlen + l;
+      if (p >= s.k) s.ring[(p - s.k + 1) % s.ring.size()] = s.current;
+    }
+
+    /* aggregated tracks go after the others, as they need the tiles their
+     * sources push at this same position
+     */
+
+    for (size_t j = 0; j < tracks.size(); ++j) {
+      track &t = tracks[j];
+      if (t.source >= 0) continue;
+      for (size_t i = 0; i < t.counters.size(); ++i) {
+        const klet_stream &s = streams[t.counters[i].stream];
+        if (p >= s.k && p - s.k + 1 >= t.START) {
+          add_klet(t, i, s.ring[(p - s.k + 1) % s.ring.size()], s, st);
+        }
+      }
+      if (p == t.START + t.window - 1) {
+        emit_rolling(t, tracks, streams, st, p, out, nozero);
+      }
+    }
 
-  while (input >> l) {
-    out += l;
-    ++counter;
-    if (counter == window) break;
+    for (size_t j = 0; j < tracks.size(); ++j) {
+      track &t = tracks[j];
+      if (t.source >= 0 && p == t.START + t.window - 1) {
+        emit_aggregate(t, tracks, streams[t.counters[0].stream], p, out, nozero);
+      }
+    }
+
+    if (out.length() >= BUFFER_SIZE) {
+      output.write(out.data(), out.length());
+      out.clear();
+    }
+
+  });
+
+  if (seqlen < mink) {
+    cerr << "Error: sequence cannot be smaller than k\n";
+    cerr << "Run countwin -h to see usage.\n";
+    exit(EXIT_FAILURE);
   }
 
-  return out;
+  /* finish with the partial windows at the end of the sequence; aggregated
+   * tracks go last since they need the final tiles of their sources
+   */
+
+  for (size_t j = 0; j < tracks.size(); ++j) {
+    track &t = tracks[j];
+    if (t.source >= 0) continue;
+    while (t.START + t.k - 1 <= seqlen) {
+      emit_rolling(t, tracks, streams, st, seqlen, out, nozero);
+    }
+  }
+
+  for (size_t j = 0; j < tracks.size(); ++j) {
+    track &t = tracks[j];
+    if (t.source < 0) continue;
+    while (t.START + t.k - 1 <= seqlen) {
+      emit_aggregate(t, tracks, streams[t.counters[0].stream], seqlen, out, nozero);
+    }
+  }
+
+  output.write(out.data(), out.length());
+
+}
+
+size_t find_stream(vector<klet_stream> &streams, unsigned int k,
+    const vector<char> &lets_uniq) {
+
+  for (size_t i = 0; i < streams.size(); ++i) {
+    if (streams[i].k == k) return i;
+  }
+
+  klet_stream s;
+  s.k = k;
+  s.nletsm1 = pow(lets_uniq.size(), k - 1);
+  s.current = 0;
+  s.klets = make_klets(lets_uniq, k);
+  streams.push_back(s);
+
+  return streams.size() - 1;
 
 }
 
 int main(int argc, char **argv) {
 
-  int ku{1};
-  unsigned int k;
-  unsigned long START{1};
   int opt;
-  unsigned long STOP, window = 0, step = 0;
-  size_t alphlen;
-  string alph, seq;
+  size_t alphlen, nsteps;
+  string alph, stats, item, seqname, filename;
   ifstream infile;
+  twobit_file tb;
+  unique_ptr<twobit_buf> tbbuf;
+  istream tbin(NULL);
   ofstream outfile;
-  bool has_file{false}, has_out{false}, has_win{false}, nozero{false}, has_step{false};
-  vector<string> klets;
+  bool has_file{false}, has_out{false}, nozero{false};
+  vector<unsigned long> kus, windows, steps;
+  vector<unsigned int> let2int(256, 0);
+  vector<klet_stream> streams;
+  vector<track> tracks;
   set<unsigned int> lets_set;
   vector<char> lets_uniq;
-  vector<unsigned long> counts;
-
-  while ((opt = getopt(argc, argv, "i:o:a:k:w:s:nh")) != -1) {
+  unsigned int mink;
+  stat_setup st;
+  bool need_mono{false}, need_di{false}, need_kl{false};
+  size_t last{0}, next{0};
+  long c_i{-1}, g_i{-1};
+
+  static struct option long_opts[] = {
+    {"stat", required_argument, 0, 'S'},
+    {0, 0, 0, 0}
+  };
+
+  while ((opt = getopt_long(argc, argv, "i:o:a:k:w:s:r:nh", long_opts, 0)) != -1) {
     switch (opt) {
 
       case 'i': if (optarg) {
@@ -108,9 +494,13 @@ int main(int argc, char **argv) {
                     exit(EXIT_FAILURE);
                   }
                   has_file = true;
+                  filename = optarg;
                 }
                 break;
 
+      case 'r': if (optarg) seqname = optarg;
+                break;
+
       case 'o': if (optarg) {
                   outfile.open(optarg);
                   if (outfile.bad()) {
@@ -125,37 +515,31 @@ int main(int argc, char **argv) {
       case 'a': if (optarg) alph = optarg;
                 break;
 
-      case 'k': if (optarg) ku = atoi(optarg);
+      case 'k': if (optarg) kus = parse_list(optarg, 'k');
                 break;
 
-      case 'w': if (optarg) {
-                  window = atol(optarg);
-                  has_win = true;
-                }
+      case 'w': if (optarg) windows = parse_list(optarg, 'w');
                 break;
 
-      case 's': if (optarg) {
-                  step = atol(optarg);
-                  has_step = true;
-                }
+      case 's': if (optarg) steps = parse_list(optarg, 's');
                 break;
 
       case 'n': nozero = true;
                 break;
 
+      case 'S': if (optarg) stats = optarg;
+                break;
+
       case 'h': usage();
                 return 0;
 
-    }
-  }
+      default: cerr << "Run countwin -h to see usage.\n";
+               exit(EXIT_FAILURE);
 
-  if (ku < 1) {
-    cerr << "Error: k must be greater than 0\n";
-    cerr << "Run countwin -h to see usage.\n";
-    exit(EXIT_FAILURE);
+    }
   }
 
-  k = ku;
+  if (kus.empty()) kus.push_back(1);
 
   if (!has_file) {
     if (isatty(STDIN_FILENO)) {
@@ -170,20 +554,14 @@ int main(int argc, char **argv) {
     exit(EXIT_FAILURE);
   }
 
-  if (!has_win) {
-    window = k;
-  } else {
-    if (window < k) {
-      cerr << "Error: window size must be equal to or greater than k\n";
-      cerr << "Run countwin -h to see usage.\n";
-      exit(EXIT_FAILURE);
-    }
+  nsteps = steps.size();
+  if (windows.empty() && nsteps > 1) {
+    cerr << "Error: multiple step sizes require window sizes\n";
+    cerr << "Run countwin -h to see usage.\n";
+    exit(EXIT_FAILURE);
   }
-
-  if (!has_step) step = window;
-
-  if (step < 1 || step > window) {
-    cerr << "Error: step size must be between 1 and window size\n";
+  if (nsteps > 1 && nsteps != windows.size()) {
+    cerr << "Error: provide either one step size or one per window size\n";
     cerr << "Run countwin -h to see usage.\n";
     exit(EXIT_FAILURE);
   }
@@ -193,63 +571,238 @@ int main(int argc, char **argv) {
   }
   lets_uniq.assign(lets_set.begin(), lets_set.end());
   alphlen = lets_uniq.size();
-  klets = make_klets(lets_uniq, k);
+  for (size_t i = 0; i < alphlen; ++i) {
+    let2int[(unsigned char)lets_uniq[i]] = i;
+  }
 
-  if (has_file) {
-    outfile << "START\tSTOP\tLET\tCOUNT\n";
-  } else {
-    cout << "START\tSTOP\tLET\tCOUNT\n";
+  /* parse --stat */
+
+  if (!stats.empty()) {
+    while (true) {
+      next = stats.find(',', last);
+      item = stats.substr(last, next == string::npos ? string::npos : next - last);
+      if (item == "gc") {
+        st.stats.push_back(STAT_GC);
+        need_mono = true;
+      } else if (item == "cpg") {
+        st.stats.push_back(STAT_CPG);
+        need_mono = true;
+        need_di = true;
+      } else if (item == "entropy") {
+        st.stats.push_back(STAT_ENTROPY);
+      } else if (item == "kl") {
+        st.stats.push_back(STAT_KL);
+        need_kl = true;
+      } else {
+        cerr << "Error: unknown --stat value '" << item << "'\n";
+        cerr << "Run countwin -h to see usage.\n";
+        exit(EXIT_FAILURE);
+      }
+      if (next == string::npos) break;
+      last = next + 1;
+    }
   }
 
-  /* initialise */
+  st.logs = false;
+  for (size_t i = 0; i < st.stats.size(); ++i) {
+    if (st.stats[i] == STAT_ENTROPY || st.stats[i] == STAT_KL) st.logs = true;
+  }
 
-  if (has_file) {
-    seq = extract_window(infile, window);
-  } else {
-    seq = extract_window(cin, window);
+  for (size_t i = 0; i < alphlen; ++i) {
+    if (toupper(lets_uniq[i]) == 'G' || toupper(lets_uniq[i]) == 'C') {
+      st.gc_i.push_back(i);
+    }
+    if (lets_uniq[i] == 'C' || (lets_uniq[i] == 'c' && c_i < 0)) c_i = i;
+    if (lets_uniq[i] == 'G' || (lets_uniq[i] == 'g' && g_i < 0)) g_i = i;
   }
-  STOP = START + seq.length() - 1;
-  if (seq.length() < k) {
-    cerr << "Error: sequence cannot be smaller than k\n";
+  if (need_mono && st.gc_i.empty()) {
+    cerr << "Error: gc and cpg require G and/or C in the alphabet\n";
     cerr << "Run countwin -h to see usage.\n";
     exit(EXIT_FAILURE);
   }
-  counts = count_klets(seq, lets_uniq, k, alphlen);
-  if (has_out) {
-    outfile << make_row(to_string(START), to_string(STOP), counts, klets, nozero);
-  } else {
-    cout << make_row(to_string(START), to_string(STOP), counts, klets, nozero);
+  if (need_di) {
+    if (c_i < 0 || g_i < 0) {
+      cerr << "Error: cpg requires both C and G in the alphabet\n";
+      cerr << "Run countwin -h to see usage.\n";
+      exit(EXIT_FAILURE);
+    }
+    st.c_i = c_i;
+    st.g_i = g_i;
+    st.cg_i.push_back(c_i * alphlen + g_i);
+  }
+  if (need_kl && !has_file) {
+    cerr << "Error: kl needs to read the input twice and requires -i\n";
+    cerr << "Run countwin -h to see usage.\n";
+    exit(EXIT_FAILURE);
   }
-  START += step;
-
-  /* loop the rest */
 
-  while (true) {
+  /* set up one track per (window, step, k) combination */
+
+  for (size_t i = 0; i < kus.size(); ++i) {
+
+    unsigned int k = kus[i];
+    size_t nwin = windows.empty() ? 1 : windows.size();
+
+    for (size_t j = 0; j < nwin; ++j) {
+
+      track t;
+      klet_counter c;
+      t.k = k;
+      t.window = windows.empty() ? k : windows[j];
+      if (nsteps == 0) t.step = t.window;
+      else if (nsteps == 1) t.step = steps[0];
+      else t.step = steps[j];
+      t.source = -1;
+      t.START = 1;
+      t.mono = -1;
+      t.di = -1;
+      t.slogs = 0;
+      t.qlogs = 0;
+
+      if (t.window < k) {
+        cerr << "Error: window size must be equal to or greater than k\n";
+        cerr << "Run countwin -h to see usage.\n";
+        exit(EXIT_FAILURE);
+      }
+
+      if (t.step < 1 || t.step > t.window) {
+        cerr << "Error: step size must be between 1 and window size\n";
+        cerr << "Run countwin -h to see usage.\n";
+        exit(EXIT_FAILURE);
+      }
+
+      c.stream = find_stream(streams, k, lets_uniq);
+      c.counts.assign(streams[c.stream].klets.size(), 0);
+      t.counters.push_back(c);
+
+      if (need_mono && k != 1) {
+        c.stream = find_stream(streams, 1, lets_uniq);
+        c.counts.assign(alphlen, 0);
+        t.mono = t.counters.size();
+        t.counters.push_back(c);
+      }
+      if (need_di) {
+        if (k == 2) {
+          t.di = 0;
+        } else {
+          c.stream = find_stream(streams, 2, lets_uniq);
+          c.counts.assign(alphlen * alphlen, 0);
+          t.di = t.counters.size();
+          t.counters.push_back(c);
+        }
+      }
+
+      if (kus.size() > 1 || nwin > 1) {
+        t.prefix = to_string(t.window) + '\t' + to_string(t.step) + '\t'
+          + to_string(k) + '\t';
+      }
+
+      tracks.push_back(t);
 
-    seq.erase(0, step);
-    if (has_file) {
-      seq += extract_window(infile, step);
-    } else {
-      seq += extract_window(cin, step);
     }
 
-    if (seq.length() < k) break;
+  }
 
-    counts = count_klets(seq, lets_uniq, k, alphlen);
+  /* Aggregate larger windows from the largest smaller tiling track (step equal
+   * to window) which divides both the window and step sizes, as long as
+   * summing the tiles is cheaper than sliding over every letter.
+   */
+
+  for (size_t i = 0; i < tracks.size() && st.stats.empty(); ++i) {
+    track &t = tracks[i];
+    long best{-1};
+    for (size_t j = 0; j < tracks.size(); ++j) {
+      const track &src = tracks[j];
+      if (j == i || src.k != t.k || src.source >= 0) continue;
+      if (src.step != src.window || src.window >= t.window) continue;
+      if (t.window % src.window != 0 || t.step % src.window != 0) continue;
+      if ((t.window + t.step) / src.window * t.counters[0].counts.size() >= t.step)
+        continue;
+      if (best < 0 || src.window > tracks[best].window) best = j;
+    }
+    if (best >= 0 && t.sinks.empty()) {
+      t.source = best;
+      tracks[best].sinks.push_back(i);
+    }
+  }
 
-    STOP = START + seq.length() - 1;
+  mink = kus[0];
+  for (size_t i = 0; i < kus.size(); ++i) mink = min(mink, (unsigned int)kus[i]);
+  for (size_t i = 0; i < streams.size(); ++i) {
+    unsigned long ringlen{0};
+    for (size_t j = 0; j < tracks.size(); ++j) {
+      for (size_t h = 0; h < tracks[j].counters.size(); ++h) {
+        if (tracks[j].counters[h].stream == i)
+          ringlen = max(ringlen, tracks[j].window);
+      }
+    }
+    streams[i].ring.assign(ringlen, 0);
+  }
 
-    if (has_out) {
-      outfile << make_row(to_string(START), to_string(STOP), counts, klets, nozero);
-    } else {
-      cout << make_row(to_string(START), to_string(STOP), counts, klets, nozero);
+  if (st.logs) {
+    unsigned long maxwin{0};
+    for (size_t i = 0; i < tracks.size(); ++i) maxwin = max(maxwin, tracks[i].window);
+    st.dxlogx.reserve(maxwin + 1);
+    st.dxlogx.push_back(0);
+    for (unsigned long c = 1; c <= maxwin; ++c) {
+      st.dxlogx.push_back((c + 1) * log2(c + 1) - c * log2(c));
     }
+  }
 
-    START += step;
+  /* .2bit input is decoded on the fly */
 
+  if (has_file && is_twobit(filename.c_str())) {
+    infile.close();
+    tb = twobit_open(filename.c_str());
+    tbbuf.reset(new twobit_buf(tb, twobit_find(tb, seqname)));
+    tbin.rdbuf(tbbuf.get());
+  } else if (!seqname.empty()) {
+    cerr << "Error: -r is only used with .2bit input\n";
+    cerr << "Run countwin -h to see usage.\n";
+    exit(EXIT_FAILURE);
+  }
+
+  ostream &output = has_out ? outfile : cout;
+  istream &input = tbbuf ? tbin : has_file ? infile : cin;
+
+  if (need_kl) {
+    vector<klet_stream> profiles;
+    for (size_t i = 0; i < tracks.size(); ++i) {
+      find_stream(profiles, tracks[i].k, lets_uniq);
+    }
+    count_profile(input, profiles, let2int, alphlen);
+    for (size_t i = 0; i < tracks.size(); ++i) {
+      size_t s = tracks[i].counters[0].stream;
+      streams[s].log2q = profiles[find_stream(profiles, tracks[i].k, lets_uniq)].log2q;
+    }
+    input.clear();
+    input.seekg(0);
   }
 
+  if (tracks.size() > 1) output << "WINDOW\tSTEP\tK\t";
+  if (st.stats.empty()) {
+    output << "START\tSTOP\tLET\tCOUNT\n";
+  } else {
+    output << "START\tSTOP";
+    for (size_t i = 0; i < st.stats.size(); ++i) {
+      switch (st.stats[i]) {
+        case STAT_GC: output << "\tGC";
+                      break;
+        case STAT_CPG: output << "\tCPG";
+                       break;
+        case STAT_ENTROPY: output << "\tENTROPY";
+                           break;
+        case STAT_KL: output << "\tKL";
+                      break;
+      }
+    }
+    output << '\n';
+  }
+
+  count_windows(input, output, tracks, streams, st, let2int, alphlen, mink, nozero);
+
   if (has_file) infile.close();
+  if (tbbuf) twobit_close(tb);
   if (has_out) outfile.close();
 
   return 0;
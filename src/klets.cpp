@@ -21,10 +21,14 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
 #include <iomanip>
 #include <cmath>
 #include <algorithm>
 #include <unordered_map>
+#include "klets.hpp"
 using namespace std;
 
 #ifdef ADD_TIMERS
@@ -128,3 +132,65 @@ vector<unsigned long> count_klets(const string &letters, const vector<char> &let
   return let_counts;
 
 }
+
+klet_table read_klet_table(const char *filename) {
+
+  klet_table table;
+  ifstream infile(filename);
+  string line, klet;
+  vector<pair<string, double>> rows;
+  vector<int> let2int(256, -1);
+  unsigned long l, nlets{1};
+  double count, total{0};
+
+  if (!infile.good()) {
+    cerr << "Error: could not open k-let count file\n";
+    exit(EXIT_FAILURE);
+  }
+
+  while (getline(infile, line)) {
+    if (line.empty()) continue;
+    /* anything after the count, such as a trailing tab, is ignored */
+    istringstream fields(line);
+    if (!(fields >> klet >> count) || count < 0
+        || (!rows.empty() && klet.length() != rows[0].first.length())) {
+      cerr << "Error: could not parse k-let count file line [" << line << "]\n";
+      exit(EXIT_FAILURE);
+    }
+    rows.push_back(make_pair(klet, count));
+    for (size_t i = 0; i < klet.length(); ++i) let2int[(unsigned char)klet[i]] = 0;
+    total += count;
+  }
+
+  if (rows.empty() || total == 0) {
+    cerr << "Error: k-let count file has no counts\n";
+    exit(EXIT_FAILURE);
+  }
+
+  for (unsigned int c = 0; c < 256; ++c) {
+    if (let2int[c] == 0) {
+      let2int[c] = table.letters.length();
+      table.letters += (char)c;
+    }
+  }
+  table.k = rows[0].first.length();
+  for (unsigned int i = 0; i < table.k; ++i) {
+    nlets *= table.letters.length();
+    if (nlets > 1UL << 32) {
+      cerr << "Error: too many k-lets in k-let count file\n";
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  table.counts.assign(nlets, 0);
+  for (size_t i = 0; i < rows.size(); ++i) {
+    l = 0;
+    for (size_t j = 0; j < table.k; ++j) {
+      l = l * table.letters.length() + let2int[(unsigned char)rows[i].first[j]];
+    }
+    table.counts[l] += rows[i].second;
+  }
+
+  return table;
+
+}
@@ -29,4 +29,16 @@ std::vector<std::string> make_klets(const std::vector<char> &lets_uniq, unsigned
 std::vector<unsigned long> count_klets(const std::string &letters,
     const std::vector<char> &lets_uniq, unsigned int k, size_t alphlen);
 
+/* A table of k-let counts as written by countlets (k-let, tab, count). The
+ * letters are those found in the k-lets, in byte order, and the counts are
+ * indexed as base alphlen numbers, first letter highest.
+ */
+struct klet_table {
+  unsigned int k;
+  std::string letters;
+  std::vector<double> counts;
+};
+
+klet_table read_klet_table(const char *filename);
+
 #endif
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2026 Benjamin Jean-Marie Tremblay
+ *
+ * This file is part of sequence-utils.
+ *
+ * sequence-utils is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * sequence-utils is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with sequence-utils.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _RNG_
+#define _RNG_
+
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <cctype>
+#include <random>
+
+/* splitmix64, used to expand a single seed into generator state */
+inline uint64_t splitmix64(uint64_t &x) {
+  uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+/* A seed for the ith of several independent streams derived from one seed */
+inline uint64_t stream_seed(uint64_t seed, uint64_t i) {
+  uint64_t x = splitmix64(seed) ^ i;
+  return splitmix64(x);
+}
+
+/* xoshiro256** by D. Blackman and S. Vigna. Meets the requirements of a
+ * UniformRandomBitGenerator so it can be used with <random> and <algorithm>;
+ * jump() advances the state by 2^128 draws, for non-overlapping streams.
+ */
+class xoshiro256ss {
+  public:
+    typedef uint64_t result_type;
+    explicit xoshiro256ss(uint64_t seed = 0) { this->seed(seed); }
+    void seed(uint64_t seed) {
+      for (int i = 0; i < 4; ++i) s[i] = splitmix64(seed);
+    }
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+    result_type operator()() {
+      const uint64_t result = rotl(s[1] * 5, 7) * 9;
+      const uint64_t t = s[1] << 17;
+      s[2] ^= s[0];
+      s[3] ^= s[1];
+      s[1] ^= s[2];
+      s[0] ^= s[3];
+      s[2] ^= t;
+      s[3] = rotl(s[3], 45);
+      return result;
+    }
+    void jump() {
+      static const uint64_t JUMP[] = { 0x180EC6D33CFD0ABAULL,
+        0xD5A61266F0C9392CULL, 0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL };
+      uint64_t t[4] = {0, 0, 0, 0};
+      for (int i = 0; i < 4; ++i) {
+        for (int b = 0; b < 64; ++b) {
+          if (JUMP[i] & (1ULL << b)) {
+            for (int j = 0; j < 4; ++j) t[j] ^= s[j];
+          }
+          (*this)();
+        }
+      }
+      for (int j = 0; j < 4; ++j) s[j] = t[j];
+    }
+  private:
+    uint64_t s[4];
+    static uint64_t rotl(const uint64_t x, int k) {
+      return (x << k) | (x >> (64 - k));
+    }
+};
+
+__extension__ typedef unsigned __int128 pcg128_t;
+
+/* PCG64 (XSL RR 128/64) by M. E. O'Neill: a 128-bit LCG with a permuted
+ * output. jump() advances the state by 2^64 draws.
+ */
+class pcg64 {
+  public:
+    typedef uint64_t result_type;
+    explicit pcg64(uint64_t seed = 0) { this->seed(seed); }
+    void seed(uint64_t seed) {
+      uint64_t s[4];
+      for (int i = 0; i < 4; ++i) s[i] = splitmix64(seed);
+      inc = ((((pcg128_t)s[2]) << 64) | s[3]) | 1;
+      state = 0;
+      step();
+      state += (((pcg128_t)s[0]) << 64) | s[1];
+      step();
+    }
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+    result_type operator()() {
+      step();
+      uint64_t x = (uint64_t)(state >> 64) ^ (uint64_t)state;
+      unsigned int rot = state >> 122;
+      return (x >> rot) | (x << ((-rot) & 63));
+    }
+    void advance(pcg128_t delta) {
+      pcg128_t mult = MULT, plus = inc, acc_mult = 1, acc_plus = 0;
+      while (delta > 0) {
+        if (delta & 1) {
+          acc_mult *= mult;
+          acc_plus = acc_plus * mult + plus;
+        }
+        plus *= mult + 1;
+        mult *= mult;
+        delta >>= 1;
+      }
+      state = acc_mult * state + acc_plus;
+    }
+    void jump() { advance(((pcg128_t)1) << 64); }
+  private:
+    static constexpr pcg128_t MULT =
+      (((pcg128_t)0x2360ED051FC65DA4ULL) << 64) | 0x4385DF649FCCF645ULL;
+    pcg128_t state, inc;
+    void step() { state = state * MULT + inc; }
+};
+
+/* Generators for --rng. minstd is std::default_random_engine, which the tools
+ * used before, and is kept to reproduce earlier results.
+ */
+enum { RNG_XOSHIRO, RNG_PCG, RNG_MINSTD };
+
+inline int parse_rng(const char *name) {
+  if (strcmp(name, "xoshiro256ss") == 0) return RNG_XOSHIRO;
+  if (strcmp(name, "pcg64") == 0) return RNG_PCG;
+  if (strcmp(name, "minstd") == 0) return RNG_MINSTD;
+  return -1;
+}
+
+/* Seeds are full 64-bit numbers; returns false if the string is not one.
+ * strtoull() would take a leading sign or white space, and wrap negative
+ * numbers around, so the string has to start with a digit.
+ */
+inline bool parse_seed(const char *s, uint64_t &seed) {
+  char *end;
+  if (!isdigit((unsigned char)s[0])) return false;
+  errno = 0;
+  seed = strtoull(s, &end, 10);
+  return errno == 0 && end != s && *end == '\0';
+}
+
+/* The default seed, taken from the system's random device */
+inline uint64_t random_seed() {
+  std::random_device rd;
+  return ((uint64_t)rd() << 32) ^ rd();
+}
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2026 Benjamin Jean-Marie Tremblay
+ *
+ * This file is part of sequence-utils.
+ *
+ * sequence-utils is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * sequence-utils is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with sequence-utils.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <vector>
+#include <cmath>
+#include "sampler.hpp"
+using namespace std;
+
+alias_table make_alias(uint32_t n) {
+  alias_table table;
+  table.n = n;
+  return table;
+}
+
+cumulative_table make_cumulative(uint32_t n) {
+  cumulative_table table;
+  table.n = n;
+  return table;
+}
+
+size_t add_distribution(alias_table &table, const vector<double> &weights) {
+
+  /* Probabilities are scaled so that their mean is 1, then every column is
+   * filled up to 1 by taking from an outcome which is still above 1. The
+   * cut-off within a column is kept as a 32-bit fixed point number.
+   */
+
+  const uint32_t n = table.n;
+  const size_t d = table.cut.size() / n, offset = d * n;
+  vector<double> p(n);
+  vector<uint32_t> small, large;
+  double total{0};
+  uint32_t s, l;
+
+  for (uint32_t i = 0; i < n; ++i) total += weights[i];
+  if (total <= 0) {
+    vector<double> flat(n, 1.0);
+    return add_distribution(table, flat);
+  }
+
+  table.cut.resize(offset + n);
+  table.alias.resize(offset + n);
+  small.reserve(n);
+  large.reserve(n);
+
+  for (uint32_t i = 0; i < n; ++i) {
+    p[i] = weights[i] * n / total;
+    if (p[i] < 1.0) small.push_back(i);
+    else large.push_back(i);
+  }
+
+  while (!small.empty() && !large.empty()) {
+    s = small.back();
+    small.pop_back();
+    l = large.back();
+    table.cut[offset + s] = llround(p[s] * 4294967296.0);
+    table.alias[offset + s] = l;
+    p[l] -= 1.0 - p[s];
+    if (p[l] < 1.0) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+
+  /* what is left is 1 up to rounding error */
+
+  for (size_t i = 0; i < large.size(); ++i) {
+    table.cut[offset + large[i]] = 4294967296ULL;
+    table.alias[offset + large[i]] = large[i];
+  }
+  for (size_t i = 0; i < small.size(); ++i) {
+    table.cut[offset + small[i]] = 4294967296ULL;
+    table.alias[offset + small[i]] = small[i];
+  }
+
+  return d;
+
+}
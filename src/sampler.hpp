@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2026 Benjamin Jean-Marie Tremblay
+ *
+ * This file is part of sequence-utils.
+ *
+ * sequence-utils is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * sequence-utils is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with sequence-utils.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _SAMPLER_
+#define _SAMPLER_
+
+#include <vector>
+#include <random>
+#include <cstdint>
+
+/* 64 random bits from any generator; taken as is from 64-bit generators */
+template <class URBG> inline uint64_t random_bits(URBG &gen) {
+  if (URBG::min() == 0 && URBG::max() == UINT64_MAX) return gen();
+  return std::uniform_int_distribution<uint64_t>()(gen);
+}
+
+/* Walker's alias method, built with Vose's algorithm: a draw costs one 64-bit
+ * random number and one table lookup no matter how many outcomes there are.
+ * The high half of the random number picks a column and the low half decides
+ * between the column and its alias. Several distributions over the same
+ * number of outcomes are stored one after the other in the same table.
+ */
+struct alias_table {
+  uint32_t n;
+  std::vector<uint64_t> cut;
+  std::vector<uint32_t> alias;
+  template <class URBG> uint32_t draw(URBG &gen, size_t d = 0) const {
+    uint64_t x = random_bits(gen);
+    uint32_t j = ((x >> 32) * n) >> 32;
+    size_t i = d * n + j;
+    uint32_t keep = -(uint32_t)((x & 0xFFFFFFFF) < cut[i]);
+    return (j & keep) | (alias[i] & ~keep);
+  }
+};
+
+alias_table make_alias(uint32_t n);
+
+/* Returns the index of the new distribution. If the weights are all 0, every
+ * outcome is made equally likely.
+ */
+size_t add_distribution(alias_table &table, const std::vector<double> &weights);
+
+/* Exact draws in proportion to integer counts: a number below the total is
+ * drawn, and the outcome is the number of cumulative counts at or below it.
+ * The count is done over all outcomes without branching, which is cheaper
+ * than a search for small alphabets and cheap to build. As with the alias
+ * table, several distributions can share one table.
+ */
+struct cumulative_table {
+  uint32_t n;
+  std::vector<uint64_t> cum;
+  template <class URBG> uint32_t draw(URBG &gen, size_t d = 0) const {
+    const uint64_t *c = cum.data() + d * n;
+    uint64_t r = std::uniform_int_distribution<uint64_t>(0, c[n - 1] - 1)(gen);
+    uint32_t i{0};
+    for (uint32_t j = 0; j < n; ++j) i += c[j] <= r;
+    return i;
+  }
+};
+
+cumulative_table make_cumulative(uint32_t n);
+
+/* Distributions with a total of 0 can be added but must never be drawn. */
+template <class T>
+size_t add_distribution(cumulative_table &table, const T *counts) {
+  const size_t d = table.cum.size() / table.n;
+  uint64_t total{0};
+  for (uint32_t i = 0; i < table.n; ++i) {
+    total += counts[i];
+    table.cum.push_back(total);
+  }
+  return d;
+}
+
+#endif
@@ -22,43 +22,510 @@
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <random>
+#include <memory>
+#include <cstring>
+#include <cerrno>
+#include <thread>
+#include <getopt.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rng.hpp"
+#include "sampler.hpp"
+#include "twobit.hpp"
+#include "klets.hpp"
+#include "shuffle_markov.hpp"
 using namespace std;
 
+#define BLOCK_SIZE 1048576
+
 void usage() {
   printf(
-    "seqgen v1.3  Copyright (C) 2019  Benjamin Jean-Marie Tremblay                   \n"
+    "seqgen v1.6  Copyright (C) 2019  Benjamin Jean-Marie Tremblay                   \n"
     "                                                                                \n"
     "Usage:  seqgen [options] -a [letters] -l [length] -o [outfile]                  \n"
     "        seqgen [options] -a [letters] -l [length] > [outfile]                   \n"
     "                                                                                \n"
-    " -o <str>    Output filename. Alternatively, prints to stdout.                  \n"
+    " -o <str>    Output filename. Alternatively, prints to stdout. If the name ends \n"
+    "             in .2bit, output is written in UCSC .2bit format.                  \n"
     " -a <str>    Sequence letters. Use commas to separate the letters if any of them\n"
     "             are longer than a single character.                                \n"
     " -w <str>    Comma-seperated letter weights. Order matches that of letters. If  \n"
     "             missing, assumes equal likelihood for all letters.                 \n"
+    " -m <str>    Generate from a Markov model instead of independent letters. The   \n"
+    "             file is a table of k-let counts as written by countlets; the       \n"
+    "             sequence then follows an order k-1 model. Not used with -a or -w.  \n"
+    "             Contexts absent from the table are followed by letters drawn from  \n"
+    "             the overall letter frequencies.                                    \n"
     " -l <int>    Final sequence length. This length is the number of characters in  \n"
-    "             output string.                                                     \n"
-    " -s <int>    RNG seed number. Defaults to time in seconds.                      \n"
+    "             output string. With -n, lengths can instead be drawn from a        \n"
+    "             distribution: uniform:<min>,<max>, normal:<mean>,<sd> or           \n"
+    "             lognormal:<meanlog>,<sdlog>.                                       \n"
+    " -n <int>    Generate this many sequences, written in fasta format with names   \n"
+    "             seq1, seq2, ... and 80 characters per line.                        \n"
+    " -L <str>    File of sequence lengths, one per line. Generates one sequence per \n"
+    "             length in fasta format; with -n, lengths are instead drawn at      \n"
+    "             random from the file.                                              \n"
+    " -s <int>    RNG seed number, from 0 to 2^64-1. Defaults to a random seed.     \n"
+    " --rng <str>                                                                    \n"
+    "             Random number generator: xoshiro256ss, pcg64 or minstd. Defaults   \n"
+    "             to xoshiro256ss. minstd gives the same sequences as v1.4 and older \n"
+    "             for the same seed, and is only available for a single sequence     \n"
+    "             from -a and -w; it always uses one thread.                         \n"
+    " -t <int>    Number of threads. The output is the same for any number of        \n"
+    "             threads. Defaults to 1.                                            \n"
     " -h          Print usage and exit.                                              \n"
   );
 }
 
+/* Output goes out in whole blocks, either with write() or to the .2bit
+ * writer.
+ */
+struct seq_writer {
+  int fd;
+  ostream *os;
+  void put(const char *p, size_t n) {
+    ssize_t w;
+    if (os != NULL) {
+      os->write(p, n);
+      return;
+    }
+    while (n > 0) {
+      w = write(fd, p, n);
+      if (w < 0) {
+        if (errno == EINTR) continue;
+        cerr << "Error: could not write output\n";
+        exit(EXIT_FAILURE);
+      }
+      p += w;
+      n -= w;
+    }
+  }
+};
+
+/* Letters are drawn as indices into the alphabet, a block at a time. Without
+ * weights, as many letters as possible are taken from each 64-bit draw: bits
+ * are used directly for alphabets with a power-of-two size, and otherwise
+ * each 32-bit half gives a letter with Lemire's multiply-shift method
+ * (rejecting only the rare draws which would bias the result). Weighted
+ * letters come from an alias table.
+ */
+struct letter_sampler {
+  uint32_t alphlen;
+  unsigned int bits;
+  bool pow2, weighted;
+  uint32_t threshold;
+  alias_table weights;
+  vector<char> table;
+  unsigned int per_byte;
+};
+
+letter_sampler make_sampler(const vector<string> &lets, const vector<double> &freqs) {
+
+  letter_sampler ls;
+  bool single{true};
+
+  ls.alphlen = lets.size();
+  ls.weighted = !freqs.empty();
+  if (ls.weighted) {
+    ls.weights = make_alias(ls.alphlen);
+    add_distribution(ls.weights, freqs);
+  }
+  ls.bits = 0;
+  while ((1ULL << ls.bits) < ls.alphlen) ++ls.bits;
+  ls.pow2 = (1ULL << ls.bits) == ls.alphlen;
+  ls.threshold = (uint32_t)(-ls.alphlen) % ls.alphlen;
+
+  /* single-character alphabets of up to 256 letters get a table which turns
+   * every random byte into 8/bits letters at once
+   */
+
+  for (size_t i = 0; i < lets.size(); ++i) {
+    if (lets[i].length() != 1) single = false;
+  }
+  ls.per_byte = 0;
+  if (single && !ls.weighted && ls.pow2 && ls.bits > 0 && ls.bits <= 8) {
+    ls.per_byte = 8 / ls.bits;
+    ls.table.resize(256 * ls.per_byte);
+    for (unsigned int b = 0; b < 256; ++b) {
+      for (unsigned int j = 0; j < ls.per_byte; ++j) {
+        ls.table[b * ls.per_byte + j] = lets[(b >> (j * ls.bits)) & (ls.alphlen - 1)][0];
+      }
+    }
+  } else if (single) {
+    for (size_t i = 0; i < lets.size(); ++i) ls.table.push_back(lets[i][0]);
+  }
+
+  return ls;
+
+}
+
+template <class URBG>
+void draw_indices(const letter_sampler &ls, URBG &gen, uint32_t *out, size_t n) {
+
+  if (ls.weighted) {
+    for (size_t i = 0; i < n; ++i) out[i] = ls.weights.draw(gen);
+  } else if (ls.bits == 0) {
+    for (size_t i = 0; i < n; ++i) out[i] = 0;
+  } else if (ls.pow2) {
+    const unsigned int per = 64 / ls.bits;
+    const uint64_t mask = ls.alphlen - 1;
+    size_t i{0};
+    while (i < n) {
+      uint64_t x = random_bits(gen);
+      for (unsigned int j = 0; j < per && i < n; ++j, ++i) {
+        out[i] = x & mask;
+        x >>= ls.bits;
+      }
+    }
+  } else {
+    uint64_t x{0}, m;
+    bool half{false};
+    for (size_t i = 0; i < n; ++i) {
+      do {
+        if (!half) x = random_bits(gen);
+        else x >>= 32;
+        half = !half;
+        m = (x & 0xFFFFFFFF) * ls.alphlen;
+      } while ((uint32_t)m < ls.threshold);
+      out[i] = m >> 32;
+    }
+  }
+
+}
+
+template <class URBG>
+void draw_letters(const letter_sampler &ls, URBG &gen, vector<uint32_t> &idx,
+    const vector<string> &lets, string &out, size_t n) {
+
+  out.clear();
+
+  if (ls.per_byte > 0) {
+    /* a spare draw's worth of letters at the end is simply dropped */
+    out.resize(n + 8 * ls.per_byte);
+    char *p = &out[0];
+    for (size_t i = 0; i < n; i += 8 * ls.per_byte) {
+      uint64_t x = random_bits(gen);
+      for (unsigned int j = 0; j < 8; ++j, x >>= 8) {
+        memcpy(p, ls.table.data() + (x & 0xFF) * ls.per_byte, ls.per_byte);
+        p += ls.per_byte;
+      }
+    }
+    out.resize(n);
+    return;
+  }
+
+  idx.resize(n);
+  draw_indices(ls, gen, idx.data(), n);
+  if (!ls.table.empty()) {
+    out.resize(n);
+    for (size_t i = 0; i < n; ++i) out[i] = ls.table[idx[i]];
+  } else {
+    for (size_t i = 0; i < n; ++i) out += lets[idx[i]];
+  }
+
+}
+
+/* Every block of letters has its own stream: block b starts from the seeded
+ * state jumped b times, so the output does not depend on the number of
+ * threads. With n threads, thread t draws blocks t, t + n, t + 2n, ... and
+ * keeps its state positioned on its next block in states[t].
+ */
+template <class URBG, class F>
+void draw_blocks(vector<URBG> &states, const letter_sampler &ls,
+    const vector<string> &lets, long seqlen, unsigned long from, unsigned long to,
+    F each) {
+
+  unsigned int nthreads = states.size();
+  vector<thread> threads;
+
+  auto work = [&, nthreads](unsigned int t) {
+    vector<uint32_t> idx;
+    string block;
+    for (unsigned long b = from + t; b < to; b += nthreads) {
+      URBG gen = states[t];
+      draw_letters(ls, gen, idx, lets, block,
+          min((long)BLOCK_SIZE, seqlen - (long)b * BLOCK_SIZE));
+      each(b, block);
+      for (unsigned int j = 0; j < nthreads; ++j) states[t].jump();
+    }
+  };
+
+  if (nthreads == 1) {
+    work(0);
+    return;
+  }
+  for (unsigned int t = 0; t < nthreads; ++t) threads.push_back(thread(work, t));
+  for (unsigned int t = 0; t < nthreads; ++t) threads[t].join();
+
+}
+
+template <class URBG>
+void generate_sequence(const letter_sampler &sampler, const vector<string> &lets,
+    URBG &gen, long seqlen, unsigned int nthreads, int outfile,
+    seq_writer &output) {
+
+  unsigned long nblocks = (seqlen + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  vector<URBG> states;
+  struct stat sb;
+  char *map{NULL};
+
+  for (unsigned int t = 0; t < nthreads; ++t) {
+    states.push_back(gen);
+    gen.jump();
+  }
+
+  /* With single-character letters the output size is known, so threads can
+   * write straight into their own part of a mapped output file. Otherwise
+   * blocks are generated a round at a time and written out in order.
+   */
+
+  if (nthreads > 1 && outfile >= 0 && !sampler.table.empty()
+      && fstat(outfile, &sb) == 0 && S_ISREG(sb.st_mode)
+      && ftruncate(outfile, seqlen + 1) == 0) {
+    map = (char *)mmap(NULL, seqlen + 1, PROT_WRITE, MAP_SHARED, outfile, 0);
+    if (map == MAP_FAILED) map = NULL;
+  }
+
+  if (map != NULL) {
+    draw_blocks(states, sampler, lets, seqlen, 0, nblocks,
+        [map](unsigned long b, const string &block) {
+      memcpy(map + b * BLOCK_SIZE, block.data(), block.length());
+    });
+    map[seqlen] = '\n';
+    munmap(map, seqlen + 1);
+  } else {
+    vector<string> round(nthreads * 4);
+    for (unsigned long r = 0; r < nblocks; r += round.size()) {
+      draw_blocks(states, sampler, lets, seqlen, r, min(nblocks, r + round.size()),
+          [&round, r](unsigned long b, const string &block) {
+        round[b - r] = block;
+      });
+      for (unsigned long b = r; b < min(nblocks, r + round.size()); ++b) {
+        output.put(round[b - r].data(), round[b - r].length());
+      }
+    }
+    output.put("\n", 1);
+  }
+
+}
+
+/* Sequence lengths for multiple records: fixed, drawn from a distribution, or
+ * taken from a list read from a file (in order, or at random).
+ */
+enum { LEN_FIXED, LEN_FILE, LEN_UNIFORM, LEN_NORMAL, LEN_LOGNORMAL };
+
+struct length_spec {
+  int type;
+  long fixed;
+  double a, b;
+  vector<long> lengths;
+  bool in_order;
+};
+
+length_spec parse_length(const string &arg) {
+
+  length_spec spec;
+  size_t colon = arg.find(':'), comma;
+  string name;
+
+  spec.type = LEN_FIXED;
+  spec.fixed = 0;
+  spec.in_order = false;
+  if (colon == string::npos) {
+    spec.fixed = atol(arg.c_str());
+    return spec;
+  }
+
+  name = arg.substr(0, colon);
+  comma = arg.find(',', colon);
+  if (name == "uniform") spec.type = LEN_UNIFORM;
+  else if (name == "normal") spec.type = LEN_NORMAL;
+  else if (name == "lognormal") spec.type = LEN_LOGNORMAL;
+  if (spec.type == LEN_FIXED || comma == string::npos) {
+    cerr << "Error: could not parse -l option [" << arg << "]\n";
+    cerr << "Run seqgen -h to see usage.\n";
+    exit(EXIT_FAILURE);
+  }
+  spec.a = atof(arg.substr(colon + 1, comma - colon - 1).c_str());
+  spec.b = atof(arg.substr(comma + 1).c_str());
+  if ((spec.type == LEN_UNIFORM && (spec.a < 1 || spec.b < spec.a)) || spec.b < 0) {
+    cerr << "Error: invalid length distribution [" << arg << "]\n";
+    cerr << "Run seqgen -h to see usage.\n";
+    exit(EXIT_FAILURE);
+  }
+
+  return spec;
+
+}
+
+void read_lengths(const char *filename, length_spec &spec) {
+
+  ifstream infile(filename);
+  long l;
+
+  if (!infile.good()) {
+    cerr << "Error: could not open lengths file\n";
+    cerr << "Run seqgen -h to see usage.\n";
+    exit(EXIT_FAILURE);
+  }
+  while (infile >> l) {
+    if (l < 1) {
+      cerr << "Error: lengths must be above 0 [" << l << "]\n";
+      exit(EXIT_FAILURE);
+    }
+    spec.lengths.push_back(l);
+  }
+  if (!infile.eof() || spec.lengths.empty()) {
+    cerr << "Error: could not parse lengths file\n";
+    exit(EXIT_FAILURE);
+  }
+  spec.type = LEN_FILE;
+
+}
+
+template <class URBG>
+long draw_length(const length_spec &spec, URBG &gen, unsigned long i) {
+
+  double x{0};
+
+  switch (spec.type) {
+    case LEN_FIXED: return spec.fixed;
+    case LEN_FILE: if (spec.in_order) return spec.lengths[i];
+                   return spec.lengths[uniform_int_distribution<size_t>(0,
+                       spec.lengths.size() - 1)(gen)];
+    case LEN_UNIFORM: return uniform_int_distribution<long>(spec.a, spec.b)(gen);
+    case LEN_NORMAL: x = normal_distribution<double>(spec.a, spec.b)(gen);
+                     break;
+    case LEN_LOGNORMAL: x = lognormal_distribution<double>(spec.a, spec.b)(gen);
+                        break;
+  }
+
+  return max(1L, (long)llround(x));
+
+}
+
+/* Records are generated in batches, each thread taking every nth record of a
+ * batch, and written out in order. Record i has its own stream, seeded from
+ * the seed and i, which first draws the length and then the letters.
+ */
+template <class URBG>
+void generate_records(unsigned long nrecords, const length_spec &spec,
+    const letter_sampler &ls, const markov_chain *model, const vector<string> &lets,
+    uint64_t seed, unsigned int nthreads, seq_writer &output) {
+
+  vector<string> batch(nthreads * 64);
+  vector<thread> threads;
+
+  auto work = [&](unsigned long from, unsigned long to, unsigned int t) {
+    vector<uint32_t> idx;
+    string letters;
+    URBG gen;
+    for (unsigned long i = from + t; i < to; i += nthreads) {
+      string &out = batch[i - from];
+      gen.seed(stream_seed(seed, i));
+      long len = draw_length(spec, gen, i);
+      if (model != NULL) {
+        letters.clear();
+        markov_generator(*model, len, gen, [&letters](const char *p, size_t n) {
+          letters.append(p, n);
+        });
+      } else {
+        draw_letters(ls, gen, idx, lets, letters, len);
+      }
+      out = ">seq" + to_string(i + 1) + '\n';
+      out.reserve(out.length() + letters.length() + letters.length() / 80 + 1);
+      for (size_t j = 0; j < letters.length(); j += 80) {
+        out.append(letters, j, 80);
+        out += '\n';
+      }
+    }
+  };
+
+  for (unsigned long r = 0; r < nrecords; r += batch.size()) {
+    unsigned long to = min(nrecords, r + batch.size());
+    if (nthreads == 1) {
+      work(r, to, 0);
+    } else {
+      threads.clear();
+      for (unsigned int t = 0; t < nthreads; ++t) threads.push_back(thread(work, r, to, t));
+      for (unsigned int t = 0; t < nthreads; ++t) threads[t].join();
+    }
+    for (unsigned long i = r; i < to; ++i) output.put(batch[i - r].data(), batch[i - r].length());
+  }
+
+}
+
+/* Everything which draws random numbers is compiled for each generator, with
+ * the choice made once here.
+ */
+template <class URBG>
+void generate(unsigned long nrecords, const length_spec &lenspec,
+    const letter_sampler &sampler, const markov_chain *model,
+    const vector<string> &lets, uint64_t seed, unsigned int nthreads, int outfile,
+    seq_writer &output) {
+
+  URBG gen(seed);
+
+  if (nrecords > 0) {
+    generate_records<URBG>(nrecords, lenspec, sampler, model, lets, seed, nthreads,
+        output);
+  } else if (model != NULL) {
+    /* every letter depends on the previous ones, so there is one thread */
+    markov_generator(*model, lenspec.fixed, gen, [&output](const char *p, size_t n) {
+      output.put(p, n);
+    });
+    output.put("\n", 1);
+  } else {
+    generate_sequence(sampler, lets, gen, lenspec.fixed, nthreads, outfile, output);
+  }
+
+}
+
+/* The original generation loop, one letter per draw, for --rng minstd */
+void generate_minstd(const vector<string> &lets, const vector<double> &freqs,
+    uint64_t seed, long seqlen, seq_writer &output) {
+
+  default_random_engine gen(seed);
+  discrete_distribution<unsigned int> next_let(freqs.begin(), freqs.end());
+  string block;
+
+  for (long i = 0; i < seqlen; ++i) {
+    if (freqs.empty()) block += lets[gen() % lets.size()];
+    else block += lets[next_let(gen)];
+    if (block.length() >= BLOCK_SIZE) {
+      output.put(block.data(), block.length());
+      block.clear();
+    }
+  }
+  block += '\n';
+  output.put(block.data(), block.length());
+
+}
+
 int main(int argc, char **argv) {
 
-  long seqlen{0};
-  int opt;
+  long seqlen{0}, nrecords{0};
+  int opt, nthreads{1};
+  length_spec lenspec = parse_length("0");
   size_t alphlen;
-  ofstream outfile;
+  int outfile{STDOUT_FILENO};
   bool has_out{false}, has_freqs{false};
-  default_random_engine gen;
   vector<string> lets;
   vector<double> freqs;
-  string outletters, all_lets, all_freqs, final_freq, final_let;
+  string all_lets, all_freqs, final_freq, final_let;
   string comma = ",";
-  unsigned int iseed = time(0);
+  uint64_t iseed = random_seed();
+  int rng{RNG_XOSHIRO};
   size_t last, next;
+  string outname;
+  const char *modelfile{NULL}, *lengthfile{NULL};
+  markov_chain model;
+  unique_ptr<twobit_writer> tbout;
+  ostream tbstream(NULL);
 
   if (argc == 1) {
     cerr << "Error: missing alphabet and sequence length\n";
@@ -66,11 +533,23 @@ int main(int argc, char **argv) {
     return 0;
   }
 
-  while ((opt = getopt(argc, argv, "a:o:l:s:w:h")) != -1) {
+  static struct option long_opts[] = {
+    {"rng", required_argument, 0, 'R'},
+    {0, 0, 0, 0}
+  };
+
+  while ((opt = getopt_long(argc, argv, "a:o:l:L:m:n:s:t:w:h", long_opts, 0)) != -1) {
     switch (opt) {
       case 'o': if (optarg) {
-                  outfile.open(optarg);
-                  if (outfile.bad()) {
+                  outname = optarg;
+                  if (outname.length() > 5
+                      && outname.compare(outname.length() - 5, 5, ".2bit") == 0) {
+                    tbout.reset(new twobit_writer(outname));
+                    tbstream.rdbuf(tbout.get());
+                    break;
+                  }
+                  outfile = open(optarg, O_RDWR | O_CREAT | O_TRUNC, 0644);
+                  if (outfile < 0) {
                     cerr << "Error: could not create outfile\n";
                     cerr << "Run seqgen -h to see usage.\n";
                     exit(EXIT_FAILURE);
@@ -78,12 +557,30 @@ int main(int argc, char **argv) {
                   has_out = true;
                 }
                 break;
-      case 'l': if (optarg) seqlen = atol(optarg);
+      case 'l': if (optarg) lenspec = parse_length(optarg);
                 break;
-      case 's': if (optarg) iseed = atoi(optarg);
+      case 'L': if (optarg) lengthfile = optarg;
+                break;
+      case 'n': if (optarg) nrecords = atol(optarg);
+                break;
+      case 's': if (optarg && !parse_seed(optarg, iseed)) {
+                  cerr << "Error: could not parse seed [" << optarg << "]\n";
+                  cerr << "Run seqgen -h to see usage.\n";
+                  exit(EXIT_FAILURE);
+                }
+                break;
+      case 'R': if (optarg && (rng = parse_rng(optarg)) < 0) {
+                  cerr << "Error: unknown --rng value '" << optarg << "'\n";
+                  cerr << "Run seqgen -h to see usage.\n";
+                  exit(EXIT_FAILURE);
+                }
+                break;
+      case 't': if (optarg) nthreads = atoi(optarg);
                 break;
       case 'a': if (optarg) all_lets = string(optarg);
                 break;
+      case 'm': if (optarg) modelfile = optarg;
+                break;
       case 'w': if (optarg) {
                   all_freqs = string(optarg);
                   has_freqs = true;
@@ -94,15 +591,50 @@ int main(int argc, char **argv) {
     }
   }
 
-  if (seqlen < 1) {
+  if (nthreads < 1) {
+    cerr << "Error: number of threads must be greater than 0\n";
+    cerr << "Run seqgen -h to see usage.\n";
+    exit(EXIT_FAILURE);
+  }
+
+  if (lengthfile != NULL) read_lengths(lengthfile, lenspec);
+  seqlen = lenspec.fixed;
+
+  if (lenspec.type == LEN_FIXED && seqlen < 1) {
     cerr << "Error: please input a desired sequence length above 0\n";
     cerr << "Run seqgen -h to see usage.\n";
     exit(EXIT_FAILURE);
   }
 
+  if (nrecords < 0 || (nrecords == 0 && lenspec.type != LEN_FIXED
+        && lenspec.type != LEN_FILE)) {
+    cerr << "Error: -n must be a positive integer when lengths are drawn\n";
+    cerr << "Run seqgen -h to see usage.\n";
+    exit(EXIT_FAILURE);
+  }
+
+  if (lenspec.type == LEN_FILE && nrecords == 0) {
+    lenspec.in_order = true;
+    nrecords = lenspec.lengths.size();
+  }
+
+  if (rng == RNG_MINSTD && (modelfile != NULL || nrecords > 0)) {
+    cerr << "Error: --rng minstd cannot be used with -m, -n or -L\n";
+    cerr << "Run seqgen -h to see usage.\n";
+    exit(EXIT_FAILURE);
+  }
+
+  if (modelfile != NULL && (!all_lets.empty() || has_freqs)) {
+    cerr << "Error: -m cannot be used with -a or -w\n";
+    cerr << "Run seqgen -h to see usage.\n";
+    exit(EXIT_FAILURE);
+  }
+
   /* split up letters */
 
-  if (all_lets.find_first_of(",") != string::npos) {
+  if (modelfile != NULL) {
+    model = table_markov(read_klet_table(modelfile));
+  } else if (all_lets.find_first_of(",") != string::npos) {
     last = 0;
     next = 0;
     while ((next = all_lets.find(comma, last)) != string::npos) {
@@ -119,7 +651,7 @@ int main(int argc, char **argv) {
 
   alphlen = lets.size();
 
-  if (alphlen < 1) {
+  if (alphlen < 1 && modelfile == NULL) {
     cerr << "Error: could not parse sequence alphabet\n";
     cerr << "Run seqgen -h to see usage.\n";
     exit(EXIT_FAILURE);
@@ -148,42 +680,30 @@ int main(int argc, char **argv) {
 
   /* main seq generation loop + return */
 
-  gen = default_random_engine(iseed);
-
-  if (!has_freqs) {
+  seq_writer output{outfile, tbout ? &tbstream : NULL};
+  letter_sampler sampler;
+  if (modelfile == NULL) sampler = make_sampler(lets, freqs);
 
-    if (has_out) {
-      for (long i = 0; i < seqlen; ++i) {
-        outfile << lets[gen() % alphlen];
-      }
-      outfile << '\n';
-      outfile.close();
-    } else {
-      for (long i = 0; i < seqlen; ++i) {
-        cout << lets[gen() % alphlen];
-      }
-      cout << '\n';
-    }
-
-  } else {
-
-    discrete_distribution<unsigned int> next_let(freqs.begin(), freqs.end());
-
-    if (has_out) {
-      for (long i = 0; i < seqlen; ++i) {
-        outfile << lets[next_let(gen)];
-      }
-      outfile << '\n';
-      outfile.close();
-    } else {
-      for (long i = 0; i < seqlen; ++i) {
-        cout << lets[next_let(gen)];
-      }
-      cout << '\n';
-    }
+  switch (rng) {
+    case RNG_XOSHIRO: generate<xoshiro256ss>(nrecords, lenspec, sampler,
+                          modelfile ? &model : NULL, lets, iseed, nthreads,
+                          has_out ? outfile : -1, output);
+                      break;
+    case RNG_PCG: generate<pcg64>(nrecords, lenspec, sampler,
+                      modelfile ? &model : NULL, lets, iseed, nthreads,
+                      has_out ? outfile : -1, output);
+                  break;
+    case RNG_MINSTD: generate_minstd(lets, freqs, iseed, seqlen, output);
+                     break;
+  }
 
+  if (tbout) {
+    tbstream.flush();
+    tbout->close();
+  } else if (has_out) {
+    close(outfile);
   }
 
-  return 1;
+  return 0;
 
 }
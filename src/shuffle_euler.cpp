@@ -24,10 +24,13 @@
 #include <iostream>
 #include <iomanip>
 #include <cstdlib>
-#include <cmath>
+#include <climits>
 #include <algorithm>
+#include <numeric>
 #include <random>
-#include "klets.hpp"
+#include "sampler.hpp"
+#include "rng.hpp"
+#include "shuffle_euler.hpp"
 using namespace std;
 
 #ifdef ADD_TIMERS
@@ -35,42 +38,105 @@ using namespace std;
 using Clock = chrono::high_resolution_clock;
 #endif
 
-vector<vector<unsigned long>> make_edgelist(const vector<unsigned long> &let_counts,
-    unsigned long nletsm1, size_t alphlen) {
+euler_graph make_graph(const string &letters, unsigned int k, size_t alphlen,
+    const vector<uint8_t> &let2int) {
 
-  /* 1D vector<int> --> 2D vector<vector<int>>
-   * The first layer elements are vertices, second layer are the edges.
+  euler_graph g;
+  size_t seqlen = letters.length();
+  unsigned long nlets, nletsm1{1}, l{0};
+  bool too_many{false};
+
+  /* when the (k-1)-lets cannot all be numbered, the graph is sparse and its
+   * vertices are told apart by their letters instead
    */
+  for (unsigned int i = 1; i < k && !too_many; ++i) {
+    if (nletsm1 > ULONG_MAX / alphlen) too_many = true;
+    else nletsm1 *= alphlen;
+  }
 
-  /* TODO: find a cheaper alternative */
+  g.alphlen = alphlen;
+  g.bits = 0;
+  while ((1UL << g.bits) < alphlen) ++g.bits;
+  g.pow2 = (1UL << g.bits) == alphlen;
+  g.sparse = too_many || nletsm1 > seqlen;
+
+  /* k-lets are counted with their index rolled along the sequence */
+
+  auto roll = [&g](unsigned long x, unsigned int j, unsigned long n) {
+    if (g.pow2) return ((x << g.bits) | j) & (n - 1);
+    return (x * g.alphlen + j) % n;
+  };
+
+  if (!g.sparse) {
+    nlets = nletsm1 * alphlen;
+    g.nvertices = nletsm1;
+    g.counts.assign(nlets, 0);
+    for (size_t i = 0; i < seqlen; ++i) {
+      l = roll(l, let2int[(unsigned char)letters[i]], nlets);
+      if (i + 2 == k) g.first = l;
+      if (i + 1 >= k) ++g.counts[l];
+    }
+    g.last = l % nletsm1;
+    return g;
+  }
 
-  vector<vector<unsigned long>> edgelist(nletsm1, vector<unsigned long>(alphlen));
-  unsigned long counter{0};
+  /* every (k-1)-let of the sequence, numbered by its rank among those present */
 
-  for (unsigned long i = 0; i < nletsm1; ++i) {
+  vector<unsigned long> ids(seqlen - k + 2), keys;
 
-    for (size_t j = 0; j < alphlen; ++j) {
-      edgelist[i][j] = let_counts[counter];
-      ++counter;
+  if (too_many) {
+    /* rank the positions by their (k-1)-let; the ranks come out in the same
+     * order as the indices would
+     */
+    auto differ = [&](unsigned long a, unsigned long b) {
+      return letters.compare(a, k - 1, letters, b, k - 1);
+    };
+    keys.resize(ids.size());
+    iota(keys.begin(), keys.end(), 0);
+    sort(keys.begin(), keys.end(), [&](unsigned long a, unsigned long b) {
+      return differ(a, b) < 0;
+    });
+    g.nvertices = 0;
+    for (size_t j = 0; j < keys.size(); ++j) {
+      if (j > 0 && differ(keys[j - 1], keys[j]) != 0) ++g.nvertices;
+      ids[keys[j]] = g.nvertices;
+    }
+    ++g.nvertices;
+  } else {
+    for (size_t i = 0; i < seqlen; ++i) {
+      l = roll(l, let2int[(unsigned char)letters[i]], nletsm1);
+      if (i + 2 >= k) ids[i + 2 - k] = l;
     }
+    keys = ids;
+    sort(keys.begin(), keys.end());
+    keys.erase(unique(keys.begin(), keys.end()), keys.end());
+    for (size_t p = 0; p < ids.size(); ++p) {
+      ids[p] = lower_bound(keys.begin(), keys.end(), ids[p]) - keys.begin();
+    }
+    g.nvertices = keys.size();
+  }
 
+  g.counts.assign(g.nvertices * alphlen, 0);
+  g.succ.assign(g.nvertices * alphlen, 0);
+  for (size_t p = 0; p + 1 < ids.size(); ++p) {
+    l = ids[p] * alphlen + let2int[(unsigned char)letters[p + k - 1]];
+    ++g.counts[l];
+    g.succ[l] = ids[p + 1];
   }
+  g.first = ids.front();
+  g.last = ids.back();
 
-  return edgelist;
+  return g;
 
 }
 
-vector<unsigned long> find_euler(const vector<vector<unsigned long>> &edgelist,
-    unsigned long lasti, unsigned long nletsm1, default_random_engine &gen,
-    size_t alphlen, unsigned int k, const vector<bool> &empty_vertices, bool verbose) {
+template <class URBG>
+vector<uint8_t> find_euler(const euler_plan &plan, URBG &gen, bool verbose) {
 
+  const euler_graph &g = plan.graph;
   unsigned long u;
-  unsigned long nletsm2 = pow(alphlen, k - 2);
-  unsigned long good_v{0}, counter{0};
-  vector<bool> vertices(nletsm1, false);
-  vector<unsigned long> last_letsi(nletsm1, 0);
-  vector<unsigned long> next_let_i;
-  next_let_i.reserve(nletsm1);
+  vector<bool> vertices(plan.empty_vertices);
+  vector<uint8_t> last_letsi(g.nvertices, 0);
 
   /* The idea is to go through and make sure that every last letter for each
    * vertex makes it so that a walk with no dead-ends to the tree root is
@@ -78,37 +144,19 @@ vector<unsigned long> find_euler(const vector<vector<unsigned long>> &edgelist,
    * edge graph; these don't need to be checked.
    */
 
-  /* TODO: find a cheaper alternative */
-
-  vertices[lasti] = true;  /* tree root */
-
-  /* I don't think there's a formula for this, so just prepare these beforehand */
-  for (unsigned long i = 0; i < nletsm1; ++i) {
-    next_let_i.push_back(counter * alphlen);
-    if (counter == nletsm2 - 1) counter = 0;
-    else ++counter;
-  }
-
-  for (unsigned long i = 0; i < nletsm1; ++i) {
-    if (empty_vertices[i]) vertices[i] = true;  /* ignore unconnected vertices */
-    else ++good_v;
-  }
+  vertices[g.last] = true;  /* tree root */
 
-  if (verbose) cerr << "    Total vertices to travel: " << good_v << endl;
+  if (verbose) cerr << "    Total vertices to travel: " << plan.good_v << endl;
 
-  for (unsigned long i = 0; i < nletsm1; ++i) {
+  for (unsigned long i = 0; i < g.nvertices; ++i) {
 
     u = i;
 
     while (!vertices[u]) {
       /* pick a random possible edge from the vertex */
-      discrete_distribution<unsigned long> next_let(edgelist[u].begin(), edgelist[u].end());
-      last_letsi[u] = next_let(gen);
+      last_letsi[u] = plan.next_let.draw(gen, u);
       /* now follow the edge to the next vertex */
-      if (k == 2)
-        u = last_letsi[u];
-      else
-        u = next_let_i[u] + last_letsi[u];
+      u = g.next(u, last_letsi[u]);
     }
 
     u = i;
@@ -118,10 +166,7 @@ vector<unsigned long> find_euler(const vector<vector<unsigned long>> &edgelist,
      */
     while (!vertices[u]) {
       vertices[u] = true;
-      if (k == 2)
-        u = last_letsi[u];
-      else
-        u = next_let_i[u] + last_letsi[u];
+      u = g.next(u, last_letsi[u]);
     }
 
   }
@@ -130,160 +175,147 @@ vector<unsigned long> find_euler(const vector<vector<unsigned long>> &edgelist,
 
 }
 
-vector<vector<unsigned int>> fill_vertices(const vector<vector<unsigned long>> &edgelist,
-    const vector<unsigned long> &last_letsi, unsigned long nletsm1, size_t alphlen,
-    unsigned long lasti, default_random_engine &gen, const vector<bool> &empty_vertices) {
+template <class URBG>
+void fill_vertices(const euler_plan &plan, const vector<uint8_t> &last_letsi,
+    URBG &gen, vector<uint8_t> &edges) {
 
-  /* The incoming edgelist is just a set of counts for each letter. This
-   * will actually create vectors of letter indices based on counts.
+  /* The counts are turned into the letters of the edges, which are shuffled in
+   * place. Every vertex but the last keeps its chosen last edge at the end.
+   * Letters are kept as 8-bit codes, indices into lets_uniq, until the walk.
    */
 
-  /* TODO: find a cheaper alternative */
-
-  vector<vector<unsigned int>> edgelist2(nletsm1);
-  unsigned long b;
+  const euler_graph &g = plan.graph;
+  const vector<unsigned long> &offsets = plan.offsets;
+  size_t alphlen = g.alphlen;
+  unsigned long e, b;
 
-  for (unsigned long i = 0; i < nletsm1; ++i) {
+  edges.resize(offsets[g.nvertices]);
 
-    if (empty_vertices[i]) continue;
+  for (unsigned long i = 0; i < g.nvertices; ++i) {
 
-    edgelist2[i].reserve(accumulate(edgelist[i].begin(), edgelist[i].end(), 0));
+    if (offsets[i] == offsets[i + 1]) continue;
 
+    e = offsets[i];
     for (size_t j = 0; j < alphlen; ++j) {
-
-      b = edgelist[i][j];
-      for (unsigned long h = 0; h < b; ++h) {
-        edgelist2[i].push_back(j);
-      }
-
+      b = g.counts[i * alphlen + j];
+      if (i != g.last && j == last_letsi[i]) --b;
+      for (unsigned long h = 0; h < b; ++h) edges[e++] = j;
     }
 
-    shuffle(edgelist2[i].begin(), edgelist2[i].end(), gen);
+    shuffle(edges.begin() + offsets[i], edges.begin() + e, gen);
 
     /* to ensure the walk is Eulerian, manually insert the last edges */
-    if (i != lasti) edgelist2[i].push_back(last_letsi[i]);
+    if (i != g.last) edges[e] = last_letsi[i];
 
   }
 
-  return edgelist2;
-
 }
 
-vector<unsigned long> walk_euler(const vector<vector<unsigned int>> &edgelist2,
-    size_t seqlen, const vector<char> &lets_uniq, string firstl) {
+void walk_euler(const euler_plan &plan, const vector<uint8_t> &edges,
+    string &out) {
 
-  size_t alphlen = lets_uniq.size();
-  size_t nletsm1 = edgelist2.size();
-  unsigned long current{0};
+  const euler_graph &g = plan.graph;
+  const string &firstl = plan.firstl;
+  unsigned long current = g.first;
+  unsigned int l;
   size_t n = firstl.length();
-  vector<unsigned long> edgelist_counter(nletsm1, 0);
-  vector<unsigned long> out_i;
-  out_i.reserve(seqlen);
+  vector<unsigned long> edgelist_counter(plan.offsets.begin(), plan.offsets.end() - 1);
+
+  out.resize(plan.seqlen);
 
   /* initialize shuffled sequence with starting vertex */
-  for (size_t i = 0; i < n; ++i) {
-    for (size_t j = 0; j < alphlen; ++j) {
-      if (firstl.substr(i, 1)[0] == lets_uniq[j]) {
-        out_i.push_back(j);
-        break;
-      }
-    }
-  }
+  for (size_t i = 0; i < n; ++i) out[i] = firstl[i];
 
-  /* walk */
+  /* walk; the next vertex is found by rolling the index along */
 
-  for (size_t i = n - 1; i < seqlen - 1; ++i) {
-
-    /* find out which vertex we are sitting on */
-    current = 0;
-    for (int j = n - 1; j >= 0; --j) {
-      current += pow(alphlen, j) * (out_i[i - j] % alphlen);
-    }
+  for (size_t i = n; i < plan.seqlen; ++i) {
 
     /* select a random availabe edge */
-    out_i.push_back(edgelist2[current][edgelist_counter[current]]);
-    ++edgelist_counter[current];
+    l = edges[edgelist_counter[current]++];
+    out[i] = plan.lets_uniq[l];
+    current = g.next(current, l);
 
   }
 
-  return out_i;
-
 }
 
-string shuffle_euler(const string &letters, default_random_engine &gen, unsigned int k,
-    bool verbose) {
+euler_plan make_euler_plan(const string &letters, unsigned int k, bool verbose) {
 
   #ifdef ADD_TIMERS
-  cerr << ">BEGIN shuffler_euler()" << endl;
-  auto t0 = Clock::now();
+  auto t5 = Clock::now();
   #endif
 
+  euler_plan plan;
   size_t seqlen = letters.length();
-  unsigned long nletsm1, nlets = 0;
   size_t alphlen;
-  unsigned long lasti{0};
-  vector<unsigned long> last_letsi, out_i;
-  vector<unsigned long> let_counts;
-  vector<char> lets_uniq;
+  unsigned long e{0};
+  vector<uint8_t> let2int(256, 0);
   set<unsigned int> lets_set;
-  vector<vector<unsigned long>> edgelist;
-  string firstl, out;
 
   /* the first and last letters remain unchanged; these are special vertices
    * which only have a single directed edge to them
    */
-  for (unsigned int i = 0; i < k - 1; ++i) {
-    firstl += letters[i];
-  }
+  plan.firstl = letters.substr(0, k - 1);
+  plan.seqlen = seqlen;
 
   for (size_t i = 0; i < seqlen; ++i) {
     lets_set.insert(letters[i]);
   }
-  lets_uniq.assign(lets_set.begin(), lets_set.end());
+  plan.lets_uniq.assign(lets_set.begin(), lets_set.end());
 
-  alphlen = lets_uniq.size();
-  nlets = pow(alphlen, k);
-  nletsm1 = pow(alphlen, k - 1);
+  alphlen = plan.lets_uniq.size();
+  for (size_t j = 0; j < alphlen; ++j) let2int[(unsigned char)plan.lets_uniq[j]] = j;
 
-  let_counts = count_klets(letters, lets_uniq, k, alphlen);
+  plan.graph = make_graph(letters, k, alphlen, let2int);
+  const euler_graph &g = plan.graph;
 
-  for (int i = k - 2; i >= 0; --i) {
-    for (size_t j = 0; j < alphlen; ++j) {
-      if (letters[seqlen - 1 - i] == lets_uniq[j]) {
-        lasti += pow(alphlen, i) * j;
-        continue;
-      }
-    }
+  if (verbose && g.sparse) {
+    cerr << "  Using a sparse graph of " << g.nvertices << " vertices" << endl;
   }
 
-  #ifdef ADD_TIMERS
-  auto t5 = Clock::now();
-  #endif
+  /* check for unconnected vertices; ignore these when searching for a new
+   * Eulerian path
+   */
+  plan.empty_vertices.assign(g.nvertices, true);
+  plan.good_v = 0;
+  plan.offsets.resize(g.nvertices + 1);
+  for (unsigned long i = 0; i < g.nvertices; ++i) {
+    plan.offsets[i] = e;
+    for (size_t j = 0; j < alphlen; ++j) e += g.counts[i * alphlen + j];
+    if (e > plan.offsets[i]) {
+      plan.empty_vertices[i] = false;
+      ++plan.good_v;
+    }
+  }
+  plan.offsets[g.nvertices] = e;
 
-  /* edgelist with letter counts */
-  edgelist = make_edgelist(let_counts, nletsm1, alphlen);
+  /* one sampler per vertex, built once instead of at every step */
+  plan.next_let = make_cumulative(alphlen);
+  plan.next_let.cum.reserve(g.nvertices * alphlen);
+  for (unsigned long i = 0; i < g.nvertices; ++i) {
+    add_distribution(plan.next_let, g.counts.data() + i * alphlen);
+  }
 
   #ifdef ADD_TIMERS
   auto t6 = Clock::now();
-  cerr << " make_edgelist\t"
+  cerr << " make_euler_plan\t"
     << chrono::duration_cast<chrono::microseconds>(t6 - t5).count()
     << " us" << endl;
   #endif
 
-  /* check for unconnected vertices; ignore these when searching for a new
-   * Eulerian path
-   */
-  vector<bool> empty_vertices;
-  empty_vertices.reserve(nletsm1);
-  for (unsigned long i = 0; i < nletsm1; ++i) {
-    empty_vertices.push_back(true);
-    for (size_t j = 0; j < alphlen; ++j) {
-      if (edgelist[i][j] > 0) {
-        empty_vertices[i] = false;
-        break;
-      }
-    }
-  }
+  return plan;
+
+}
+
+template <class URBG>
+void shuffle_euler(const euler_plan &plan, URBG &gen, string &out, bool verbose) {
+
+  #ifdef ADD_TIMERS
+  cerr << ">BEGIN shuffler_euler()" << endl;
+  auto t0 = Clock::now();
+  #endif
+
+  vector<uint8_t> last_letsi, edges;
 
   if (verbose) cerr << "  Finding a random Eulerian path" << endl;
 
@@ -292,8 +324,7 @@ string shuffle_euler(const string &letters, default_random_engine &gen, unsigned
   #endif
 
   /* find a new Eulerian path */
-  last_letsi = find_euler(edgelist, lasti, nletsm1, gen, alphlen, k,
-      empty_vertices, verbose);
+  last_letsi = find_euler(plan, gen, verbose);
 
   #ifdef ADD_TIMERS
   auto t10 = Clock::now();
@@ -302,12 +333,6 @@ string shuffle_euler(const string &letters, default_random_engine &gen, unsigned
     << " us" << endl;
   #endif
 
-  /* delete last edges from edge pool */
-  vector<vector<unsigned int>> edgelist2;
-  for (size_t i = 0; i < last_letsi.size(); ++i) {
-    if (i != lasti) --edgelist[i][last_letsi[i]];
-  }
-
   if (verbose) cerr << "  Generating random edges" << endl;
 
   #ifdef ADD_TIMERS
@@ -315,8 +340,7 @@ string shuffle_euler(const string &letters, default_random_engine &gen, unsigned
   #endif
 
   /* generate edge indices + shuffle */
-  edgelist2 = fill_vertices(edgelist, last_letsi, nletsm1, alphlen, lasti, gen,
-      empty_vertices);
+  fill_vertices(plan, last_letsi, gen, edges);
 
   #ifdef ADD_TIMERS
   auto t12 = Clock::now();
@@ -328,13 +352,7 @@ string shuffle_euler(const string &letters, default_random_engine &gen, unsigned
   if (verbose) cerr << "  Walking new Eulerian path" << endl;
 
   /* walk new Eulerian path */
-  out_i = walk_euler(edgelist2, seqlen, lets_uniq, firstl);
-
-  /* indices --> letters */
-  out.reserve(out_i.size());
-  for (size_t i = 0; i < out_i.size(); ++i) {
-    out += lets_uniq[out_i[i]];
-  }
+  walk_euler(plan, edges, out);
 
   #ifdef ADD_TIMERS
   auto t16 = Clock::now();
@@ -344,6 +362,8 @@ string shuffle_euler(const string &letters, default_random_engine &gen, unsigned
   cerr << ">END shuffler_euler()" << endl;
   #endif
 
-  return out;
-
 }
+
+template void shuffle_euler(const euler_plan &, xoshiro256ss &, string &, bool);
+template void shuffle_euler(const euler_plan &, pcg64 &, string &, bool);
+template void shuffle_euler(const euler_plan &, default_random_engine &, string &, bool);
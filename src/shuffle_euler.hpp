@@ -22,9 +22,58 @@
 #define _SHUFFLE_EULER_
 
 #include <string>
+#include <vector>
 #include <random>
+#include "sampler.hpp"
 
-std::string shuffle_euler(const std::string &letters, std::default_random_engine &gen,
-    unsigned int k, bool verbose);
+/* The de Bruijn graph of the sequence: the vertices are (k-1)-lets, and every
+ * k-let is an edge from the vertex of its first k-1 letters to that of its
+ * last k-1 letters. The edges leaving vertex v are counted in
+ * counts[v * alphlen + j], one count per following letter j.
+ *
+ * Vertices are normally indexed as base alphlen numbers, first letter highest,
+ * so following an edge is a matter of rolling the index along. When there are
+ * more possible vertices than letters in the sequence (large k, or large
+ * alphabets), only the vertices present in the sequence are kept: they are
+ * numbered in the same order, so the shuffle comes out the same, and the
+ * vertex at the end of each edge is stored in succ.
+ */
+struct euler_graph {
+  size_t alphlen;
+  unsigned long nvertices, first, last;
+  unsigned int bits;
+  bool sparse, pow2;
+  std::vector<unsigned long> counts, succ;
+  unsigned long next(unsigned long v, unsigned int j) const {
+    if (sparse) return succ[v * alphlen + j];
+    if (pow2) return ((v << bits) | j) & (nvertices - 1);
+    return (v * alphlen + j) % nvertices;
+  }
+};
+
+/* Everything about a sequence which stays the same from one shuffle to the
+ * next: the graph, a sampler per vertex, and where the edges of every vertex
+ * go (edges[offsets[v]] to edges[offsets[v + 1] - 1]). Only the random
+ * arborescence and the order of the edges are redone for each shuffle.
+ */
+struct euler_plan {
+  euler_graph graph;
+  std::string firstl;
+  std::vector<char> lets_uniq;
+  std::size_t seqlen;
+  std::vector<bool> empty_vertices;
+  unsigned long good_v;
+  std::vector<unsigned long> offsets;
+  cumulative_table next_let;
+};
+
+euler_plan make_euler_plan(const std::string &letters, unsigned int k, bool verbose);
+
+/* The shuffled sequence replaces the contents of out. Instantiated for the
+ * generators in rng.hpp.
+ */
+template <class URBG>
+void shuffle_euler(const euler_plan &plan, URBG &gen, std::string &out,
+    bool verbose);
 
 #endif
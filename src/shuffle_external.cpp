@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2026 Benjamin Jean-Marie Tremblay
+ *
+ * This file is part of sequence-utils.
+ *
+ * sequence-utils is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * sequence-utils is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with sequence-utils.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <numeric>
+#include <iostream>
+#include <random>
+#include <cstring>
+#include <cctype>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "rng.hpp"
+#include "sampler.hpp"
+#include "shuffle_external.hpp"
+using namespace std;
+
+/* Drops the pages wholly inside [from, to) from the process; the pages of a
+ * mapped file stay in the page cache, so nothing written is lost.
+ */
+void release(const char *from, const char *to) {
+  static const uintptr_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t a = ((uintptr_t)from + page - 1) & ~(page - 1);
+  uintptr_t b = (uintptr_t)to & ~(page - 1);
+  if (a < b) madvise((void *)a, b - a, MADV_DONTNEED);
+}
+
+size_t count_letters(const char *in, size_t inlen) {
+
+  const size_t chunk{1 << 20};
+  size_t n{0};
+
+  for (size_t from = 0; from < inlen; from += chunk) {
+    size_t to = min(inlen, from + chunk);
+    for (size_t i = from; i < to; ++i) n += !isspace((unsigned char)in[i]);
+    release(in + from, in + to);
+  }
+
+  return n;
+
+}
+
+template <class URBG>
+inline uint32_t draw_bucket(URBG &gen, uint32_t nbuckets) {
+  return ((random_bits(gen) >> 32) * nbuckets) >> 32;
+}
+
+template <class URBG>
+void shuffle_external(const char *in, size_t inlen, char *out, size_t nletters,
+    unsigned int k, URBG &gen, size_t mem_limit, bool verbose) {
+
+  const char *p{in}, *end{in + inlen}, *done{in};
+  size_t nblocks{nletters / k};
+  size_t per_letter, bucket_max, nbuckets, release_every, n;
+  vector<size_t> start, cursor, idx;
+  string block(k, 0), tmp;
+  uint32_t b;
+  URBG gen0(gen);
+
+  /* with k = 1 a bucket is shuffled in place, otherwise it is copied out along
+   * with an index of its blocks; buckets are kept to half of what fits, as
+   * some come out larger than the average
+   */
+  per_letter = k == 1 ? 1 : 1 + (sizeof(size_t) + k - 1) / k;
+  bucket_max = max((size_t)k, mem_limit / per_letter / 2);
+  nbuckets = max((size_t)1, (nblocks * k + bucket_max - 1) / bucket_max);
+  if (nbuckets > UINT32_MAX) nbuckets = UINT32_MAX;
+
+  if (verbose) {
+    cerr << "  Buckets: " << nbuckets << " of about " << nblocks * k / nbuckets
+      << " letters" << endl;
+  }
+
+  /* count the blocks drawn for each bucket, then draw the same buckets again
+   * to scatter the blocks
+   */
+
+  start.assign(nbuckets + 1, 0);
+  if (nbuckets > 1) {
+    for (size_t i = 0; i < nblocks; ++i) ++start[draw_bucket(gen, nbuckets) + 1];
+    gen = gen0;
+  } else {
+    start[1] = nblocks;
+  }
+  partial_sum(start.begin(), start.end(), start.begin());
+  cursor.assign(start.begin(), start.end() - 1);
+
+  if (verbose) cerr << "  Scattering letters" << endl;
+
+  /* the letters read and written since the last release take up to twice
+   * their size, as the output pages touched are spread over the buckets
+   */
+  release_every = max((size_t)1 << 16, mem_limit / 4);
+  madvise((void *)in, inlen, MADV_SEQUENTIAL);
+
+  for (size_t i = 0; i < nblocks; ++i) {
+    for (unsigned int j = 0; j < k; ++j) {
+      while (isspace((unsigned char)*p)) ++p;
+      block[j] = *p++;
+    }
+    b = nbuckets > 1 ? draw_bucket(gen, nbuckets) : 0;
+    memcpy(out + cursor[b]++ * k, block.data(), k);
+    if (p - done >= (ptrdiff_t)release_every) {
+      release(done, p);
+      release(out, out + nletters);
+      done = p;
+    }
+  }
+
+  /* leftover letters are not shuffled */
+  for (size_t i = nblocks * k; i < nletters; ++i) {
+    while (p < end && isspace((unsigned char)*p)) ++p;
+    out[i] = *p++;
+  }
+  release(in, end);
+  release(out, out + nletters);
+
+  if (verbose) cerr << "  Shuffling buckets" << endl;
+
+  for (size_t i = 0; i < nbuckets; ++i) {
+
+    char *from = out + start[i] * k;
+    n = start[i + 1] - start[i];
+
+    if (k == 1) {
+      shuffle(from, from + n, gen);
+    } else {
+      tmp.assign(from, n * k);
+      idx.resize(n);
+      iota(idx.begin(), idx.end(), 0);
+      shuffle(idx.begin(), idx.end(), gen);
+      for (size_t j = 0; j < n; ++j) memcpy(from + j * k, tmp.data() + idx[j] * k, k);
+    }
+
+    release(from, from + n * k);
+
+  }
+
+}
+
+template void shuffle_external(const char *, size_t, char *, size_t, unsigned int,
+    xoshiro256ss &, size_t, bool);
+template void shuffle_external(const char *, size_t, char *, size_t, unsigned int,
+    pcg64 &, size_t, bool);
+template void shuffle_external(const char *, size_t, char *, size_t, unsigned int,
+    default_random_engine &, size_t, bool);
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2026 Benjamin Jean-Marie Tremblay
+ *
+ * This file is part of sequence-utils.
+ *
+ * sequence-utils is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * sequence-utils is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with sequence-utils.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _SHUFFLE_EXTERNAL_
+#define _SHUFFLE_EXTERNAL_
+
+#include <cstddef>
+#include <random>
+
+/* Shuffling of sequences too large for memory, for -k 1 and the linear
+ * method, between memory-mapped files. in holds the input, white space
+ * included, and out receives its nletters letters.
+ */
+
+std::size_t count_letters(const char *in, std::size_t inlen);
+
+/* The blocks of k letters (k = 1 for a plain shuffle) are scattered into
+ * randomly drawn buckets of out, small enough to fit in mem_limit bytes, and
+ * each bucket is then shuffled on its own (Rao-Sandelius), which gives every
+ * order of the blocks the same chance. Leftover letters stay at the end, as
+ * with shuffle_linear().
+ */
+template <class URBG>
+void shuffle_external(const char *in, std::size_t inlen, char *out,
+    std::size_t nletters, unsigned int k, URBG &gen, std::size_t mem_limit,
+    bool verbose);
+
+#endif
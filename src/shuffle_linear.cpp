@@ -23,10 +23,13 @@
 #include <random>
 #include <algorithm>
 #include <iostream>
+#include "rng.hpp"
+#include "shuffle_linear.hpp"
 using namespace std;
 
-string shuffle_linear(const string &letters, default_random_engine &gen,
-    unsigned int k, bool verbose) {
+template <class URBG>
+void shuffle_linear(const string &letters, URBG &gen, unsigned int k,
+    string &out, bool verbose) {
 
   /* variables */
 
@@ -40,7 +43,7 @@ string shuffle_linear(const string &letters, default_random_engine &gen,
     cerr << "  Remainder: " << seqrem << endl;
   }
 
-  string out;
+  out.clear();
   out.reserve(seqlen1);
 
   vector<unsigned long> seqindex;
@@ -57,21 +60,19 @@ string shuffle_linear(const string &letters, default_random_engine &gen,
   /* build output string from shuffled index */
 
   for (unsigned long i = 0; i < seqlen2; ++i) {
-    for (unsigned int j = 0; j < k; ++j) {
-      out += letters[seqindex[i] + j];
-    }
+    out.append(letters, seqindex[i], k);
   }
 
   /* add leftover letters */
 
   if (seqrem > 0) {
-    for (unsigned long i = seqremlen; i < seqlen1; ++i) {
-      out += letters[i];
-    }
+    out.append(letters, seqremlen, seqrem);
   }
 
-  /* return */
-
-  return out;
-
 }
+
+template void shuffle_linear(const string &, xoshiro256ss &, unsigned int, string &,
+    bool);
+template void shuffle_linear(const string &, pcg64 &, unsigned int, string &, bool);
+template void shuffle_linear(const string &, default_random_engine &, unsigned int,
+    string &, bool);
@@ -24,7 +24,11 @@
 #include <string>
 #include <random>
 
-std::string shuffle_linear(const std::string &letters, std::default_random_engine &gen,
-    unsigned int k, bool verbose);
+/* Instantiated for the generators in rng.hpp. The shuffled sequence replaces
+ * the contents of out, so that its storage can be reused between shuffles.
+ */
+template <class URBG>
+void shuffle_linear(const std::string &letters, URBG &gen, unsigned int k,
+    std::string &out, bool verbose);
 
 #endif
@@ -21,176 +21,197 @@
 #include <string>
 #include <vector>
 #include <random>
-#include <set>
-#include <cmath>
 #include <iostream>
-#include <iomanip>
 #include <cstdlib>
-#include <algorithm>
-#include "klets.hpp"
+#include <cmath>
+#include <cctype>
+#include "sampler.hpp"
+#include "rng.hpp"
+#include "shuffle_markov.hpp"
 using namespace std;
 
-typedef std::vector<int> vec_int_t;
-typedef std::vector<std::vector<int>> list_int_t;
+markov_chain make_chain(const std::string &alph, unsigned int k) {
 
-vec_int_t klet_counter(const vec_int_t &single_seq, const int &k,
-    const std::size_t &nlets, const std::size_t &alphlen) {
+  markov_chain mc;
 
-  vec_int_t klet_counts(nlets, 0);
-  int l, counter;
+  mc.alph = alph;
+  mc.k = k;
+  mc.alphlen = alph.size();
+  mc.mlets = 1;
+  for (unsigned int i = 1; i < k; ++i) mc.mlets *= mc.alphlen;
+  mc.nlets = mc.mlets * mc.alphlen;
+  mc.seqlen = 0;
+  mc.bits = 0;
+  while ((1UL << mc.bits) < mc.alphlen) ++mc.bits;
+  mc.pow2 = (1UL << mc.bits) == mc.alphlen;
 
-  for (std::size_t i = 0; i < single_seq.size() - k + 1; ++i) {
-    l = 0; counter = 0;
-    for (int j = k - 1; j >= 0; --j) {
-      l += pow(alphlen, j) * single_seq[i + counter];
-      ++counter;
-    }
-    ++klet_counts[l];
-  }
-
-  return klet_counts;
+  return mc;
 
 }
 
-list_int_t get_edgecounts(const vec_int_t &klet_counts, const std::size_t &mlets,
-    const std::size_t &alphlen) {
+std::vector<unsigned long> klet_counter(const std::string &single_seq,
+    const markov_chain &mc, const std::vector<uint8_t> &let2int) {
 
-  list_int_t edgecounts(mlets, vec_int_t(alphlen));
-  std::size_t counter = 0;
+  std::vector<unsigned long> klet_counts(mc.nlets, 0);
+  unsigned long l{0};
 
-  for (std::size_t i = 0; i < mlets; ++i) {
-    for (std::size_t j = 0; j < alphlen; ++j) {
-      edgecounts[i][j] = klet_counts[counter];
-      ++counter;
-    }
+  for (std::size_t i = 0; i < single_seq.size(); ++i) {
+    l = mc.roll(l, let2int[(unsigned char)single_seq[i]], mc.nlets);
+    if (i + 1 >= mc.k) ++klet_counts[l];
   }
 
-  return edgecounts;
+  return klet_counts;
 
 }
 
-std::string make_new_seq(const vec_int_t &shuffled_seq_ints,
-    const std::string &alph) {
+/* The first k letters come from the k-let counts, and every following letter
+ * from the transitions of the k-1 letters before it. A context without any
+ * transitions (one which only ends the sequence, or is absent from a table)
+ * is followed by a letter drawn from the overall letter frequencies.
+ */
+void add_transitions(markov_chain &mc, const std::vector<unsigned long> &klet_counts) {
 
-  std::string out;
-  out.reserve(shuffled_seq_ints.size());
+  std::vector<double> marginal(mc.alphlen, 0), weights;
 
-  for (std::size_t i = 0; i < shuffled_seq_ints.size(); ++i) {
-    out += alph[shuffled_seq_ints[i]];
+  for (unsigned long l = 0; l < mc.nlets; ++l) {
+    marginal[l % mc.alphlen] += klet_counts[l];
   }
 
-  return out;
+  mc.first_gen = make_alias(mc.nlets);
+  add_distribution(mc.first_gen, std::vector<double>(klet_counts.begin(),
+        klet_counts.end()));
+
+  mc.next_gen = make_alias(mc.alphlen);
+  mc.next_gen.cut.reserve(mc.nlets);
+  mc.next_gen.alias.reserve(mc.nlets);
+  for (unsigned long ctx = 0; ctx < mc.mlets; ++ctx) {
+    weights.assign(klet_counts.begin() + ctx * mc.alphlen,
+        klet_counts.begin() + (ctx + 1) * mc.alphlen);
+    bool seen = false;
+    for (double w : weights) seen = seen || w > 0;
+    add_distribution(mc.next_gen, seen ? weights : marginal);
+  }
 
 }
 
-list_int_t make_klet_lists(const std::size_t &nlets, const int &k,
-    const std::size_t &alphlen) {
+markov_chain count_markov(std::istream &input, unsigned int k) {
+
+  std::vector<char> buf(MARKOV_BLOCK);
+  std::vector<bool> present(256, false);
+  std::vector<uint8_t> let2int(256, 0);
+  std::vector<unsigned long> klet_counts;
+  std::string alph;
+  std::streamsize n;
+  unsigned long l{0}, seqlen{0};
+
+  /* the alphabet has to be known before k-lets can be indexed */
 
-  list_int_t klet_list(nlets);
-  for (std::size_t i = 0; i < nlets; ++i) {
-    klet_list[i].reserve(k);
+  while (input.read(buf.data(), buf.size()) || input.gcount() > 0) {
+    n = input.gcount();
+    for (std::streamsize i = 0; i < n; ++i) present[(unsigned char)buf[i]] = true;
   }
-  int counter, let, step;
-
-  for (int i = k - 1; i >= 0; --i) {
-    counter = 0;
-    let = 0;
-    step = pow(alphlen, i);
-    while (counter < int(nlets)) {
-      for (int j = 0; j < step; ++j) {
-        klet_list[counter].push_back(let);
-        ++counter;
-      }
-      if (let == int(alphlen) - 1)
-        let = 0;
-      else
-        ++let;
+  for (unsigned int c = 0; c < 256; ++c) {
+    if (present[c] && !isspace(c)) {
+      let2int[c] = alph.size();
+      alph += (char)c;
     }
   }
 
-  return klet_list;
+  markov_chain mc = make_chain(alph, k);
+  klet_counts.assign(mc.nlets, 0);
+
+  input.clear();
+  input.seekg(0);
+  while (input.read(buf.data(), buf.size()) || input.gcount() > 0) {
+    n = input.gcount();
+    for (std::streamsize i = 0; i < n; ++i) {
+      if (isspace((unsigned char)buf[i])) continue;
+      l = mc.roll(l, let2int[(unsigned char)buf[i]], mc.nlets);
+      if (++seqlen >= k) ++klet_counts[l];
+    }
+  }
 
-}
+  mc.seqlen = seqlen;
+  if (seqlen > k) add_transitions(mc, klet_counts);
 
-vec_int_t markov_generator(const std::size_t &seqsize, const vec_int_t &nlet_counts,
-    const list_int_t &transitions, default_random_engine &gen,
-    const std::size_t &nlets, const int &k, const std::size_t &alphlen, const bool verbose) {
+  return mc;
 
-  vec_int_t out;
-  out.reserve(seqsize);
+}
 
-  list_int_t nlet_lists = make_klet_lists(nlets, k, alphlen);
+markov_chain table_markov(const klet_table &table) {
 
-  if (verbose) {
-    cerr << "  Generating letters\n";
-  }
+  markov_chain mc = make_chain(table.letters, table.k);
+  std::vector<unsigned long> klet_counts(mc.nlets);
 
-  std::discrete_distribution<int> first_gen(nlet_counts.begin(), nlet_counts.end());
-  int firstletters = first_gen(gen);
-  for (int i = 0; i < k; ++i) {
-    out.push_back(nlet_lists[firstletters][i]);
+  for (unsigned long i = 0; i < mc.nlets; ++i) {
+    klet_counts[i] = llround(table.counts[i]);
+    mc.seqlen += klet_counts[i];
   }
+  mc.seqlen += mc.k - 1;
+  add_transitions(mc, klet_counts);
 
-  int previous_mlet;
-  for (std::size_t i = k - 1; i < seqsize - 1; ++i) {
-    previous_mlet = 0;
-    for (int j = k - 1; j >= 1; --j) {
-      previous_mlet += out[i - j] * pow(alphlen, j - 1);
-    }
-    std::discrete_distribution<int> next_gen(transitions[previous_mlet].begin(),
-        transitions[previous_mlet].end());
-    out.push_back(next_gen(gen));
-  }
+  return mc;
 
-  return out;
+}
+
+template <class URBG>
+void shuffle_markov_stream(const markov_chain &mc, URBG &gen, std::ostream &output) {
+
+  markov_generator(mc, mc.seqlen, gen, [&output](const char *p, std::size_t n) {
+    output.write(p, n);
+  });
 
 }
-// string shuffle_markov(const string &letters, default_random_engine &gen,
-//     unsigned int k, bool verbose) {
 
-std::string shuffle_markov(const std::string &single_seq,
-    default_random_engine &gen, unsigned int k, bool verbose) {
+markov_chain seq_markov(const std::string &single_seq, unsigned int k, bool verbose) {
 
-  std::set<int> alph_s;
-  for (std::size_t i = 0; i < single_seq.size(); ++i) {
-    alph_s.insert(single_seq[i]);
-  }
+  std::vector<bool> present(256, false);
+  std::vector<uint8_t> let2int(256, 0);
   std::string alph;
-  alph.assign(alph_s.begin(), alph_s.end());
-  std::size_t alphlen = alph.size();
-  std::size_t nlets = pow(alphlen, k);
-  std::size_t mlets = pow(alphlen, k - 1);
 
-  vec_int_t seq_ints(single_seq.size());
   for (std::size_t i = 0; i < single_seq.size(); ++i) {
-    for (std::size_t a = 0; a < alphlen; ++a) {
-      if (single_seq[i] == alph[a]) {
-        seq_ints[i] = a;
-        break;
-      }
+    present[(unsigned char)single_seq[i]] = true;
+  }
+  for (unsigned int c = 0; c < 256; ++c) {
+    if (present[c]) {
+      let2int[c] = alph.size();
+      alph += (char)c;
     }
   }
 
-  vec_int_t nlet_counts = klet_counter(seq_ints, k, nlets, alphlen);
-  list_int_t transitions = get_edgecounts(nlet_counts, mlets, alphlen);
+  markov_chain mc = make_chain(alph, k);
+  mc.seqlen = single_seq.size();
+  add_transitions(mc, klet_counter(single_seq, mc, let2int));
   if (verbose) {
-    cerr << "  Generated transitions matrix: " << transitions[0].size() <<
-      "x" << transitions.size() << '\n';
+    cerr << "  Generated transitions matrix: " << mc.alphlen <<
+      "x" << mc.mlets << '\n';
   }
 
-  vec_int_t out_ints = markov_generator(seq_ints.size(), nlet_counts, transitions,
-      gen, nlets, k, alphlen, verbose);
+  return mc;
 
-  if (verbose) {
-    cerr << "  Assembling final sequence\n";
-  }
+}
 
-  std::string out = make_new_seq(out_ints, alph);
+template <class URBG>
+void shuffle_markov(const markov_chain &mc, URBG &gen, std::string &out,
+    bool verbose) {
 
-  return out;
+  if (verbose) cerr << "  Generating letters\n";
+
+  out.clear();
+  out.reserve(mc.seqlen);
+  markov_generator(mc, mc.seqlen, gen, [&out](const char *p, std::size_t n) {
+    out.append(p, n);
+  });
 
 }
 
+template void shuffle_markov_stream(const markov_chain &, xoshiro256ss &, ostream &);
+template void shuffle_markov_stream(const markov_chain &, pcg64 &, ostream &);
+template void shuffle_markov_stream(const markov_chain &, default_random_engine &, ostream &);
+template void shuffle_markov(const markov_chain &, xoshiro256ss &, string &, bool);
+template void shuffle_markov(const markov_chain &, pcg64 &, string &, bool);
+template void shuffle_markov(const markov_chain &, default_random_engine &, string &, bool);
+
 // string markov_loop(const vector<string> &klets, const vector<string> &kletsm1,
 //     const vector<unsigned long> &let_counts, const vector<char> &lets_uniq,
 //     default_random_engine &gen, size_t seqlen, unsigned int k, bool verbose) {
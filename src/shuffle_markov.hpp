@@ -22,9 +22,90 @@
 #define _SHUFFLE_MARKOV_
 
 #include <string>
+#include <vector>
 #include <random>
+#include <iostream>
+#include "sampler.hpp"
+#include "klets.hpp"
 
-std::string shuffle_markov(const std::string &letters, std::default_random_engine &gen,
-    unsigned int k, bool verbose);
+#define MARKOV_BLOCK 65536
+
+/* An order k-1 Markov chain over the letters of a sequence of length seqlen.
+ * K-lets and their (k-1)-let contexts are indexed as base alphlen numbers,
+ * first letter highest, so the context after each new letter is found by
+ * rolling the index along: a shift and mask for power-of-two alphabets, and a
+ * multiply and modulo otherwise. There is one sampler per context.
+ */
+struct markov_chain {
+  std::string alph;
+  unsigned int k, bits;
+  std::size_t alphlen;
+  unsigned long nlets, mlets, seqlen;
+  bool pow2;
+  alias_table first_gen, next_gen;
+  unsigned long roll(unsigned long ctx, uint32_t l, unsigned long n) const {
+    if (pow2) return ((ctx << bits) | l) & (n - 1);
+    return (ctx * alphlen + l) % n;
+  }
+};
+
+/* Draws seqsize letters from the chain, passing them to put() a block at a
+ * time. The first k letters are drawn together as a k-let.
+ */
+template <class URBG, class F>
+void markov_generator(const markov_chain &mc, std::size_t seqsize, URBG &gen,
+    F put) {
+
+  std::vector<char> block(MARKOV_BLOCK);
+  unsigned long ctx = mc.first_gen.draw(gen);
+  std::size_t i{0}, b{0};
+  uint32_t l;
+
+  for (unsigned long w = mc.mlets; i < mc.k && i < seqsize; ++i, w /= mc.alphlen) {
+    block[b++] = mc.alph[(ctx / w) % mc.alphlen];
+  }
+  ctx %= mc.mlets;
+
+  for (; i < seqsize; ++i) {
+    l = mc.next_gen.draw(gen, ctx);
+    block[b++] = mc.alph[l];
+    ctx = mc.roll(ctx, l, mc.mlets);
+    if (b == MARKOV_BLOCK) {
+      put(block.data(), b);
+      b = 0;
+    }
+  }
+
+  if (b > 0) put(block.data(), b);
+
+}
+
+/* For sequences which are too large to keep in memory, the chain can be built
+ * from two passes over a seekable stream (white space is skipped), or from a
+ * table of counts as written by countlets. Only the counts are kept, and the
+ * shuffled sequence is written out a block at a time. If the sequence is not
+ * longer than k, the chain is left without samplers.
+ */
+markov_chain count_markov(std::istream &input, unsigned int k);
+
+/* Also used by seqgen -m. The chain always has its samplers, even if the
+ * table's sequence is not longer than k.
+ */
+markov_chain table_markov(const klet_table &table);
+
+template <class URBG>
+void shuffle_markov_stream(const markov_chain &mc, URBG &gen, std::ostream &output);
+
+/* The chain of a sequence held in memory, which can be reused for any number
+ * of shuffles.
+ */
+markov_chain seq_markov(const std::string &single_seq, unsigned int k, bool verbose);
+
+/* The shuffled sequence replaces the contents of out. Instantiated for the
+ * generators in rng.hpp.
+ */
+template <class URBG>
+void shuffle_markov(const markov_chain &mc, URBG &gen, std::string &out,
+    bool verbose);
 
 #endif
@@ -23,30 +23,63 @@
 #include <string>
 #include <algorithm>
 #include <vector>
-#include <ctime>
 #include <random>
 #include <unistd.h>
 #include <cstdlib>
+#include <cstdio>
+#include <climits>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <sstream>
+#include <functional>
+#include <cstdint>
+#include <cerrno>
+#include <cctype>
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "shuffle_linear.hpp"
+#include "shuffle_external.hpp"
 #include "shuffle_markov.hpp"
 #include "shuffle_euler.hpp"
+#include "twobit.hpp"
+#include "rng.hpp"
 using namespace std;
 
 void usage() {
   printf(
-    "shuffler v1.4  Copyright (C) 2019-2021  Benjamin Jean-Marie Tremblay            \n"
+    "shuffler v1.8  Copyright (C) 2019-2021  Benjamin Jean-Marie Tremblay            \n"
     "                                                                                \n"
     "Usage:  shuffler [options] -i [filename] -o [filename]                          \n"
     "        echo [string] | shuffler [options] > [filename]                         \n"
     "                                                                                \n"
     " -i <str>   Input filename. All white space will be removed. Alternatively, can \n"
-    "            take string input from a pipe.                                      \n"
+    "            take string input from a pipe. UCSC .2bit files are read like fasta.\n"
     " -o <str>   Output filename. Alternatively, prints to stdout. For fasta input, a\n"
-    "            newline is inserted every 80 characters.                            \n"
+    "            newline is inserted every 80 characters. If the name ends in .2bit, \n"
+    "            output is written in UCSC .2bit format.                             \n"
     " -k <int>   K-let size. Defaults to 1.                                          \n"
-    " -s <int>   RNG seed number. Defaults to time in seconds.                       \n"
-    " -m         Use the markov shuffling method. Defaults to euler.                 \n"
+    " -s <int>   RNG seed number, from 0 to 2^64-1. Defaults to a random seed.      \n"
+    " --rng <str>                                                                    \n"
+    "            Random number generator: xoshiro256ss, pcg64 or minstd. Defaults to \n"
+    "            xoshiro256ss. minstd is the generator used up to v1.5; with the same\n"
+    "            seed it gives the same results as before for -k 1 and -l on         \n"
+    "            non-fasta input, without -n.                                        \n"
+    " -m         Use the markov shuffling method. Defaults to euler. A sequence read \n"
+    "            from a file with -i is not kept in memory: k-lets are counted on a  \n"
+    "            first pass, and the output is written as it is generated. A         \n"
+    "            (k-1)-let never followed by a letter (in the sequence or the table  \n"
+    "            of -c) is followed by letters drawn from the overall letter         \n"
+    "            frequencies.                                                        \n"
     " -l         Use the linear shuffling method. Defaults to euler.                 \n"
+    " -c <str>   Markov shuffle from a table of k-let counts as written by countlets,\n"
+    "            instead of an input sequence. The k-let size and the sequence length\n"
+    "            come from the table. Not used with -i, -f, -k or -l.                \n"
     " -f         Indicate the input is fasta formatted. Each sequence will be        \n"
     "            shuffled individually. Text preceding the first sequence entry is   \n"
     "            ignored.                                                            \n"
@@ -54,85 +87,201 @@ void usage() {
     "            newline characters. If '-f' is set, then all of the individual      \n"
     "            sequences are repeated per each additional iteration, with the      \n"
     "            iteration number appended to the sequence names.                    \n"
+    "            Every repeat is shuffled with its own RNG stream.                   \n"
+    " -t <int>   Number of threads. Fasta and .2bit records are shuffled in          \n"
+    "            parallel, as are -n repeats of other input. The output is the       \n"
+    "            same for any number of threads. Defaults to 1.                      \n"
+    " --shard <i/N>                                                                  \n"
+    "            Only shuffle the ith of N equal runs of records from a fasta or     \n"
+    "            .2bit file given with -i. Each record is shuffled with its own RNG  \n"
+    "            stream, so the outputs of shards 1 to N, concatenated, match the    \n"
+    "            output of a single run with the same seed.                          \n"
+    " --mem <size>                                                                   \n"
+    "            Shuffle -k 1 or -l sequences which do not fit in memory, from a file\n"
+    "            given with -i to a file given with -o, using about <size> bytes of  \n"
+    "            memory (K, M and G suffixes are understood). Both files are mapped; \n"
+    "            letters are scattered into random buckets which are then shuffled   \n"
+    "            one at a time. Output differs from a shuffle done in memory.        \n"
     " -v         Verbose mode.                                                       \n"
     " -h         Show usage.                                                         \n"
   );
 }
 
-string do_shuffle(const string &letters, unsigned int k, default_random_engine &gen,
-    bool verbose, unsigned int method_i) {
+/* Everything which can be worked out from a sequence before shuffling it, so
+ * that -n repeats only redo the random part. Sequences no longer than k are
+ * copied as is (method 0).
+ */
+struct shuffle_plan {
+  const string *letters;
+  unsigned int k, method_i;
+  markov_chain markov;
+  euler_plan euler;
+};
+
+shuffle_plan make_plan(const string &letters, unsigned int k,
+    unsigned int method_i, bool verbose) {
+
+  shuffle_plan plan;
+  plan.letters = &letters;
+  plan.k = k;
+  plan.method_i = letters.length() > k ? method_i : 0;
+
+  switch (plan.method_i) {
+    case 2: plan.markov = seq_markov(letters, k, verbose);
+            break;
+    case 4: plan.euler = make_euler_plan(letters, k, verbose);
+            break;
+  }
+
+  return plan;
+
+}
 
-  string outletters;
+/* The shuffled sequence replaces the contents of out, whose storage is reused
+ * from one shuffle to the next.
+ */
+template <class URBG>
+void do_shuffle(const shuffle_plan &plan, URBG &gen, string &out, bool verbose) {
 
-  switch (method_i) {
+  switch (plan.method_i) {
 
-    case 1: outletters = letters;
-            shuffle(outletters.begin(), outletters.end(), gen);
+    case 0: out.assign(*plan.letters);
+            break;
+    case 1: out.assign(*plan.letters);
+            shuffle(out.begin(), out.end(), gen);
             break;
-    case 2: outletters = shuffle_markov(letters, gen, k, verbose);
+    case 2: shuffle_markov(plan.markov, gen, out, verbose);
             break;
-    case 3: outletters = shuffle_linear(letters, gen, k, verbose);
+    case 3: shuffle_linear(*plan.letters, gen, plan.k, out, verbose);
             break;
-    case 4: outletters = shuffle_euler(letters, gen, k, verbose);
+    case 4: shuffle_euler(plan.euler, gen, out, verbose);
             break;
 
   }
 
-  return outletters;
+}
+
+/* Lines are written as whole 80 character slices */
+void write_fasta_seq(const string &letters, ostream &output) {
+
+  for (size_t i = 0; i < letters.length(); i += 80) {
+    output.write(letters.data() + i, min((size_t)80, letters.length() - i));
+    output.put('\n');
+  }
+  if (letters.empty()) output.put('\n');
 
 }
 
-void shuffle_and_write(const string &letters, unsigned int k, default_random_engine &gen,
-    bool verbose, unsigned int method_i, ostream &output, bool is_fasta,
-    unsigned int n_repeats) {
+/* Repeat i of a sequence has its own stream, seeded from the sequence's seed
+ * and i, so that repeats can be shuffled in any order. The first repeat uses
+ * the sequence's seed as is, as a single shuffle always has.
+ */
+inline uint64_t repeat_seed(uint64_t seed, unsigned int i) {
+  return i == 0 ? seed : stream_seed(seed, i);
+}
 
-  vector<string> outletters(n_repeats);
-  if (letters.length() > k) {
-    for (unsigned int i = 0; i < n_repeats; ++i) {
-      outletters[i] = do_shuffle(letters, k, gen, verbose, method_i);
+/* Repeats are shuffled in batches of two per thread, each thread taking every
+ * nth repeat of a batch, and passed to write() in order as soon as the batch
+ * is done. The batch buffers are reused, so memory use depends on the number
+ * of threads and not on the number of repeats; with one thread, each repeat
+ * is written out before the next is shuffled.
+ */
+template <class URBG, class Writer>
+void shuffle_repeats(const shuffle_plan &plan, uint64_t seed,
+    unsigned int n_repeats, unsigned int nthreads, bool verbose, Writer write) {
+
+  vector<string> batch(nthreads == 1 ? 1 : nthreads * 2);
+  vector<thread> threads;
+
+  auto work = [&](unsigned int from, unsigned int to, unsigned int t) {
+    URBG gen;
+    for (unsigned int i = from + t; i < to; i += nthreads) {
+      gen.seed(repeat_seed(seed, i));
+      do_shuffle(plan, gen, batch[i - from], verbose && nthreads == 1);
     }
-  } else {
-    for (unsigned int i = 0; i < n_repeats; ++i) {
-      outletters[0] = letters;
+  };
+
+  for (unsigned int r = 0; r < n_repeats; r += batch.size()) {
+    unsigned int to = min(n_repeats, r + (unsigned int)batch.size());
+    if (nthreads == 1 || to - r == 1) {
+      work(r, to, 0);
+    } else {
+      threads.clear();
+      for (unsigned int t = 0; t < nthreads; ++t) threads.push_back(thread(work, r, to, t));
+      for (unsigned int t = 0; t < nthreads; ++t) threads[t].join();
     }
+    for (unsigned int i = r; i < to; ++i) write(i, batch[i - r]);
   }
 
-  if (!is_fasta) {
+}
 
-    for (unsigned int i = 0; i < n_repeats; ++i) {
-      output << outletters[i] << '\n';
-    }
+/* Writes the shuffled record, then any repeats under the name with the
+ * iteration number appended; the first name line is left to the caller.
+ */
+template <class URBG>
+void shuffle_record(const string &name, const string &content, unsigned int k,
+    uint64_t seed, unsigned int method_i, ostream &output, unsigned int n_repeats,
+    unsigned int nthreads) {
 
-  } else {
+  shuffle_plan plan = make_plan(content, k, method_i, false);
 
-    for (size_t i = 0; i < outletters[0].length(); ++i) {
-      if (i % 80 == 0 && i != 0) {
-        output << '\n';
-      }
-      output << outletters[0][i];
-    }
-    output << '\n';
+  shuffle_repeats<URBG>(plan, seed, n_repeats, nthreads, false,
+      [&](unsigned int i, const string &letters) {
+    if (i > 0) output << name << '-' << i << '\n';
+    write_fasta_seq(letters, output);
+  });
 
+}
+
+/* Counts the records which read_fasta_records() would pass on */
+unsigned long count_fasta_records(istream &input) {
+
+  unsigned long count_n{0};
+  bool in_record{false};
+  string line;
+
+  while (getline(input, line).good()) {
+    if (line.empty() || line[0] == '>') {
+      if (in_record) ++count_n;
+      in_record = !line.empty();
+    } else if (in_record && line.find_first_not_of(' ') == string::npos) {
+      in_record = false;
+    }
   }
+  if (in_record) ++count_n;
 
-  return;
+  return count_n;
 
 }
 
-void read_fasta_then_shuffle_and_write(istream &input, ostream &output,
-    unsigned int k, default_random_engine gen, unsigned int method_i,
-    bool verbose, unsigned int n_repeats) {
+/* A record as read from the input. Records without a sequence only have their
+ * name written, except for the last one of a fasta file.
+ */
+struct seq_record {
+  unsigned long index;
+  string name, content;
+  bool has_seq;
+};
+
+/* Reads records first to last - 1 and passes them to emit() in order. Returns
+ * the index of the last record read.
+ */
+template <class Emit>
+unsigned long read_fasta_records(istream &input, unsigned int k,
+    unsigned long first, unsigned long last, Emit emit) {
 
   unsigned long count_n{0}, count_s{0};
   string line, name, content, name_old;
+  bool keep{false}, counted, has_seq{true};
 
-  while (getline(input, line).good()) {
+  while (count_n < last && getline(input, line).good()) {
 
     if (line.empty() || line[0] == '>') {
 
-      if (!name.empty()) {
+      counted = !name.empty();
+      if (counted) {
         ++count_n;
-        output << name << '\n';
+        keep = count_n > first;
         name_old = name;
         name.clear();
       }
@@ -144,24 +293,23 @@ void read_fasta_then_shuffle_and_write(istream &input, ostream &output,
 
         ++count_s;
         if (count_s < count_n) {
-          cerr << "Warning: encountered a missing sequence ["
-            << count_n - 1 << "]" << '\n';
+          if (count_n - 1 > first) {
+            cerr << "Warning: encountered a missing sequence ["
+              << count_n - 1 << "]" << '\n';
+          }
           count_s = count_n;
         }
-        if (content.length() <= k) {
+
+        if (keep && content.length() <= k) {
           cerr << "Warning: encountered a sequence where k is too big ["
             << count_n << "]" << '\n';
         }
 
-        shuffle_and_write(content, k, gen, false, method_i, output, true, 1);
-
-        if (n_repeats > 1) {
-          for (unsigned int i = 1; i < n_repeats; ++i) {
-            output << name_old << '-' << i << '\n';
-            shuffle_and_write(content, k, gen, false, method_i, output, true, 1);
-          }
-        }
+      }
 
+      if (counted && keep) {
+        has_seq = content.length() > 0;
+        emit(seq_record{count_n - 1, name_old, move(content), has_seq});
       }
       content.clear();
 
@@ -182,9 +330,15 @@ void read_fasta_then_shuffle_and_write(istream &input, ostream &output,
 
   }
 
-  if (!name.empty()) {
+  /* a shard ends where the next record starts, before anything after it could
+   * show that its last record was missing, so that is checked here as at EOF
+   */
+  if (count_n == last && count_n > first && !has_seq) {
+    cerr << "Warning: encountered a missing sequence [" << count_n << "]\n";
+  }
+
+  if (!name.empty() && count_n >= first && count_n < last) {
     ++count_n;
-    output << name << '\n';
     if (content.length() == 0) {
       cerr << "Warning: encountered a missing sequence ["
         << count_n << "]\n";
@@ -192,17 +346,388 @@ void read_fasta_then_shuffle_and_write(istream &input, ostream &output,
       cerr << "Warning: encountered a sequence where k is too big ["
         << count_n << "]\n";
     }
-    shuffle_and_write(content, k, gen, false, method_i, output, true, 1);
-    if (n_repeats > 1) {
-      for (unsigned int i = 1; i < n_repeats; ++i) {
-        output << name << '-' << i << '\n';
-        shuffle_and_write(content, k, gen, false, method_i, output, true, 1);
+    emit(seq_record{count_n - 1, name, move(content), true});
+  }
+
+  return count_n;
+
+}
+
+template <class Emit>
+unsigned long read_twobit_records(const twobit_file &tb, unsigned int k,
+    unsigned long first, unsigned long last, Emit emit) {
+
+  string content;
+
+  last = min(last, (unsigned long)tb.names.size());
+
+  for (size_t i = first; i < last; ++i) {
+
+    content = twobit_read(tb, i);
+
+    if (content.length() == 0) {
+      cerr << "Warning: encountered a missing sequence [" << i + 1 << "]\n";
+    } else if (content.length() <= k) {
+      cerr << "Warning: encountered a sequence where k is too big ["
+        << i + 1 << "]\n";
+    }
+
+    bool has_seq = content.length() > 0;
+    emit(seq_record{i, '>' + tb.names[i], move(content), has_seq});
+
+  }
+
+  return last;
+
+}
+
+/* A queue holding at most max items, for passing work between threads. pop()
+ * returns false once the queue has been closed and emptied.
+ */
+template <class T>
+class bounded_queue {
+  public:
+    explicit bounded_queue(size_t max) : max(max), closed(false) {}
+    void push(T item) {
+      unique_lock<mutex> lock(m);
+      not_full.wait(lock, [this] { return q.size() < max; });
+      q.push_back(move(item));
+      not_empty.notify_one();
+    }
+    bool pop(T &item) {
+      unique_lock<mutex> lock(m);
+      not_empty.wait(lock, [this] { return !q.empty() || closed; });
+      if (q.empty()) return false;
+      item = move(q.front());
+      q.pop_front();
+      not_full.notify_one();
+      return true;
+    }
+    void close() {
+      lock_guard<mutex> lock(m);
+      closed = true;
+      not_empty.notify_all();
+    }
+  private:
+    size_t max;
+    bool closed;
+    deque<T> q;
+    mutex m;
+    condition_variable not_full, not_empty;
+};
+
+/* Takes numbered results in any order and hands them out in order. put() waits
+ * while its result is window or more places ahead of the next one out, so that
+ * a slow result cannot make the others pile up.
+ */
+template <class T>
+class reorder_buffer {
+  public:
+    explicit reorder_buffer(size_t window)
+      : window(window), next(0), total(SIZE_MAX) {}
+    void put(size_t id, T result) {
+      unique_lock<mutex> lock(m);
+      space.wait(lock, [&] { return id < next + window; });
+      done[id] = move(result);
+      ready.notify_all();
+    }
+    void finish(size_t n) {
+      lock_guard<mutex> lock(m);
+      total = n;
+      ready.notify_all();
+    }
+    bool take(T &result) {
+      unique_lock<mutex> lock(m);
+      ready.wait(lock, [this] { return done.count(next) || next == total; });
+      if (next == total) return false;
+      result = move(done[next]);
+      done.erase(next++);
+      space.notify_all();
+      return true;
+    }
+  private:
+    size_t window, next, total;
+    map<size_t, T> done;
+    mutex m;
+    condition_variable ready, space;
+};
+
+/* Every record is shuffled with its own stream, seeded from the seed and the
+ * record index, so that a record's output does not depend on the records
+ * before it.
+ */
+template <class URBG>
+void write_record(const seq_record &r, unsigned int k, uint64_t seed,
+    unsigned int method_i, ostream &output, unsigned int n_repeats,
+    unsigned int nthreads) {
+
+  output << r.name << '\n';
+  if (r.has_seq) {
+    shuffle_record<URBG>(r.name, r.content, k, stream_seed(seed, r.index),
+        method_i, output, n_repeats, nthreads);
+  }
+
+}
+
+/* Records passed between the threads of shuffle_records(): either a batch of
+ * small records, shuffled by the pool into out, or one large record, shuffled
+ * by the writer.
+ */
+struct record_batch {
+  size_t id;
+  vector<seq_record> records;
+  bool large;
+  string out;
+};
+
+/* With one thread, records are shuffled as they are read, and any repeats
+ * spread over threads. Otherwise a parser thread reads batches of records, a
+ * pool of threads shuffles them, and they are written out in input order here.
+ * The queue between the parser and the pool and the number of batches waiting
+ * to be written are both bounded, so memory use does not grow with the input.
+ * A record costs its length times the number of repeats; one costing more than
+ * a whole batch is not buffered but shuffled here with all threads, each
+ * repeat being written as it is done, so memory use does not grow with -n.
+ * The parser only passes on such a record once the previous one has been
+ * written, so at most two are held at any time.
+ */
+template <class URBG, class Reader>
+void shuffle_records(Reader read, ostream &output, unsigned int k, uint64_t seed,
+    unsigned int method_i, bool verbose, unsigned int n_repeats,
+    unsigned int nthreads, unsigned long first) {
+
+  const size_t max_records{256}, max_bytes{1 << 22};
+  unsigned long count_n;
+
+  if (nthreads == 1) {
+
+    count_n = read([&](seq_record &&r) {
+      write_record<URBG>(r, k, seed, method_i, output, n_repeats, 1);
+    });
+
+  } else {
+
+    bounded_queue<record_batch> todo(2 * nthreads);
+    reorder_buffer<record_batch> written(4 * nthreads);
+    vector<thread> workers;
+    record_batch result;
+    mutex large_m;
+    condition_variable large_done;
+    bool large_busy{false};
+
+    thread parser([&] {
+      record_batch batch{0, {}, false, {}};
+      size_t bytes{0};
+      auto flush = [&] {
+        size_t id = batch.id;
+        todo.push(move(batch));
+        batch = record_batch{id + 1, {}, false, {}};
+        bytes = 0;
+      };
+      count_n = read([&](seq_record &&r) {
+        size_t cost = r.content.length() * n_repeats;
+        if (cost > max_bytes) {
+          if (!batch.records.empty()) flush();
+          {
+            unique_lock<mutex> lock(large_m);
+            large_done.wait(lock, [&] { return !large_busy; });
+            large_busy = true;
+          }
+          batch.large = true;
+          batch.records.push_back(move(r));
+          flush();
+          return;
+        }
+        bytes += cost;
+        batch.records.push_back(move(r));
+        if (batch.records.size() == max_records || bytes >= max_bytes) flush();
+      });
+      if (!batch.records.empty()) flush();
+      todo.close();
+      written.finish(batch.id);
+    });
+
+    for (unsigned int t = 0; t < nthreads; ++t) {
+      workers.push_back(thread([&] {
+        record_batch batch;
+        while (todo.pop(batch)) {
+          if (!batch.large) {
+            ostringstream out;
+            for (const seq_record &r : batch.records) {
+              write_record<URBG>(r, k, seed, method_i, out, n_repeats, 1);
+            }
+            batch.records.clear();
+            batch.out = out.str();
+          }
+          size_t id = batch.id;
+          written.put(id, move(batch));
+        }
+      }));
+    }
+
+    while (written.take(result)) {
+      if (result.large) {
+        write_record<URBG>(result.records[0], k, seed, method_i, output,
+            n_repeats, nthreads);
+        result.records.clear();
+        {
+          lock_guard<mutex> lock(large_m);
+          large_busy = false;
+        }
+        large_done.notify_one();
+      } else {
+        output.write(result.out.data(), result.out.length());
       }
     }
+
+    parser.join();
+    for (unsigned int t = 0; t < nthreads; ++t) workers[t].join();
+
+  }
+
+  if (verbose) {
+    cerr << "Shuffled " << count_n - first << " sequences\n";
+  }
+
+}
+
+/* Sizes are a number of bytes, optionally followed by K, M or G */
+bool parse_size(const char *s, size_t &size) {
+
+  char *end;
+  const char *units = "KMG";
+  const char *u;
+
+  errno = 0;
+  size = strtoull(s, &end, 10);
+  if (errno != 0 || end == s) return false;
+  if (*end != '\0') {
+    u = strchr(units, toupper(*end));
+    if (u == NULL || end[1] != '\0') return false;
+    for (; u >= units; --u) size <<= 10;
+  }
+
+  return size > 0;
+
+}
+
+/* Both files are mapped, and every repeat is shuffled straight into its own
+ * part of the output file, followed by a newline.
+ */
+template <class URBG>
+void shuffle_files(const char *infile, const char *outfile, unsigned int k,
+    uint64_t seed, unsigned int n_repeats, size_t mem_limit, bool verbose) {
+
+  int in, out;
+  struct stat sb;
+  size_t inlen, nletters, outlen;
+  const char *imap;
+  char *omap;
+  URBG gen;
+
+  in = open(infile, O_RDONLY);
+  if (in < 0 || fstat(in, &sb) != 0) {
+    cerr << "Error: could not open input file\n";
+    exit(EXIT_FAILURE);
+  }
+  inlen = sb.st_size;
+  imap = inlen == 0 ? NULL
+    : (const char *)mmap(NULL, inlen, PROT_READ, MAP_PRIVATE, in, 0);
+  if (imap == MAP_FAILED) {
+    cerr << "Error: could not map input file\n";
+    exit(EXIT_FAILURE);
+  }
+
+  nletters = count_letters(imap, inlen);
+  if (nletters <= k) {
+    cerr << "Error: k must be greater than sequence length\n";
+    exit(EXIT_FAILURE);
+  }
+
+  outlen = (nletters + 1) * n_repeats;
+  out = open(outfile, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (out < 0 || ftruncate(out, outlen) != 0) {
+    cerr << "Error: could not create outfile\n";
+    exit(EXIT_FAILURE);
+  }
+  omap = (char *)mmap(NULL, outlen, PROT_READ | PROT_WRITE, MAP_SHARED, out, 0);
+  if (omap == MAP_FAILED) {
+    cerr << "Error: could not map output file\n";
+    exit(EXIT_FAILURE);
+  }
+
+  for (unsigned int i = 0; i < n_repeats; ++i) {
+    gen.seed(repeat_seed(seed, i));
+    shuffle_external(imap, inlen, omap + i * (nletters + 1), nletters, k, gen,
+        mem_limit, verbose);
+    omap[i * (nletters + 1) + nletters] = '\n';
   }
 
+  munmap(omap, outlen);
+  munmap((void *)imap, inlen);
+  close(out);
+  close(in);
+
   if (verbose) {
-    cerr << "Shuffled " << count_n << " sequences\n";
+    cerr << "Shuffled " << nletters << " characters\n";
+  }
+
+}
+
+template <class URBG>
+void shuffle_input(uint64_t seed, istream &input, ostream &output,
+    const twobit_file *tb, const markov_chain *mc, bool is_fasta, unsigned int k,
+    unsigned int method_i, bool verbose, unsigned int n_repeats,
+    unsigned int nthreads, unsigned long first, unsigned long last) {
+
+  string letters;
+  char l;
+  URBG gen;
+
+  if (tb != NULL) {
+
+    shuffle_records<URBG>([&](function<void(seq_record &&)> emit) {
+      return read_twobit_records(*tb, k, first, last, emit);
+    }, output, k, seed, method_i, verbose, n_repeats, nthreads, first);
+
+  } else if (mc != NULL) {
+
+    /* streamed repeats are not held in memory, so they are made one by one */
+    for (unsigned int i = 0; i < n_repeats; ++i) {
+      gen.seed(repeat_seed(seed, i));
+      shuffle_markov_stream(*mc, gen, output);
+      output << '\n';
+    }
+
+    if (verbose) {
+      cerr << "Shuffled " << mc->seqlen << " characters\n";
+    }
+
+  } else if (!is_fasta) {
+
+    while (input >> l) letters += l;
+
+    if (letters.length() <= k) {
+      cerr << "Error: k must be greater than sequence length\n";
+      exit(EXIT_FAILURE);
+    }
+
+    shuffle_plan plan = make_plan(letters, k, method_i, verbose);
+    shuffle_repeats<URBG>(plan, seed, n_repeats, nthreads, verbose,
+        [&output](unsigned int, const string &outletters) {
+      output << outletters << '\n';
+    });
+
+    if (verbose) {
+      cerr << "Shuffled " << letters.length() << " characters\n";
+    }
+
+  } else {
+
+    shuffle_records<URBG>([&](function<void(seq_record &&)> emit) {
+      return read_fasta_records(input, k, first, last, emit);
+    }, output, k, seed, method_i, verbose, n_repeats, nthreads, first);
+
   }
 
   return;
@@ -213,22 +738,37 @@ int main(int argc, char **argv) {
 
   /* variables */
 
-  int ku{1}, n_repeatsu{0};
-  unsigned int k{1}, method_i{1}, n_repeats{1};
+  int ku{1}, n_repeatsu{0}, nthreadsu{1};
+  unsigned int k{1}, method_i{1}, n_repeats{1}, nthreads;
   int opt;
   ifstream seqfile;
   ofstream outfile;
-  bool has_file{false}, has_out{false}, is_fasta{false};
+  bool has_file{false}, has_out{false}, is_fasta{false}, is_twobit_in{false};
   bool use_linear{false}, use_markov{false};
   bool verbose{false};
-  unsigned int iseed = time(0);
-  char l;
-  string letters;
-  default_random_engine gen;
+  uint64_t iseed = random_seed();
+  int rng{RNG_XOSHIRO};
+  unsigned long shard_i{0}, shard_n{0}, nrecords, first{0}, last{ULONG_MAX};
+  size_t mem_limit{0};
+  char shard_end;
+  string filename, outname, tablename;
+  markov_chain mc;
+  bool streaming{false};
+  struct stat sb;
+  twobit_file tb;
+  unique_ptr<twobit_writer> tbout;
+  ostream tbstream(NULL);
 
   /* arguments */
 
-  while ((opt = getopt(argc, argv, "i:k:s:o:n:mvhlf")) != -1) {
+  static struct option long_opts[] = {
+    {"rng", required_argument, 0, 'R'},
+    {"shard", required_argument, 0, 'S'},
+    {"mem", required_argument, 0, 'M'},
+    {0, 0, 0, 0}
+  };
+
+  while ((opt = getopt_long(argc, argv, "i:k:s:o:n:t:c:mvhlf", long_opts, 0)) != -1) {
     switch (opt) {
 
       case 'i': if (optarg) {
@@ -239,16 +779,51 @@ int main(int argc, char **argv) {
                     exit(EXIT_FAILURE);
                   }
                   has_file = true;
+                  filename = optarg;
                 }
                 break;
 
       case 'k': if (optarg) ku = atoi(optarg);
                 break;
 
-      case 's': if (optarg) iseed = atoi(optarg);
+      case 's': if (optarg && !parse_seed(optarg, iseed)) {
+                  cerr << "Error: could not parse seed [" << optarg << "]\n";
+                  cerr << "Run shuffler -h to see usage.\n";
+                  exit(EXIT_FAILURE);
+                }
+                break;
+
+      case 'R': if (optarg && (rng = parse_rng(optarg)) < 0) {
+                  cerr << "Error: unknown --rng value '" << optarg << "'\n";
+                  cerr << "Run shuffler -h to see usage.\n";
+                  exit(EXIT_FAILURE);
+                }
+                break;
+
+      case 'M': if (optarg && !parse_size(optarg, mem_limit)) {
+                  cerr << "Error: could not parse --mem value '" << optarg << "'\n";
+                  cerr << "Run shuffler -h to see usage.\n";
+                  exit(EXIT_FAILURE);
+                }
+                break;
+
+      case 'S': if (optarg && (sscanf(optarg, "%lu/%lu%c", &shard_i, &shard_n,
+                        &shard_end) != 2 || shard_i < 1 || shard_i > shard_n)) {
+                  cerr << "Error: could not parse --shard value '" << optarg << "'\n";
+                  cerr << "Run shuffler -h to see usage.\n";
+                  exit(EXIT_FAILURE);
+                }
                 break;
 
       case 'o': if (optarg) {
+                  outname = optarg;
+                  if (outname.length() > 5
+                      && outname.compare(outname.length() - 5, 5, ".2bit") == 0) {
+                    tbout.reset(new twobit_writer(outname));
+                    tbstream.rdbuf(tbout.get());
+                    has_out = true;
+                    break;
+                  }
                   outfile.open(optarg);
                   if (outfile.bad()) {
                     cerr << "Error: could not create outfile\n";
@@ -262,6 +837,9 @@ int main(int argc, char **argv) {
       case 'm': use_markov = true;
                 break;
 
+      case 'c': if (optarg) tablename = optarg;
+                break;
+
       case 'l': use_linear = true;
                 break;
 
@@ -274,13 +852,28 @@ int main(int argc, char **argv) {
       case 'n': if (optarg) n_repeatsu = atoi(optarg);
                 break;
 
+      case 't': if (optarg) nthreadsu = atoi(optarg);
+                break;
+
       case 'h': usage();
                 return 0;
 
     }
   }
 
-  if (!has_file && isatty(STDIN_FILENO)) {
+  if (!tablename.empty() && (has_file || is_fasta || use_linear || ku != 1)) {
+    cerr << "Error: -c cannot be used with -i, -f, -k or -l\n";
+    cerr << "Run shuffler -h to see usage.\n";
+    exit(EXIT_FAILURE);
+  }
+
+  if (!tablename.empty()) {
+    mc = table_markov(read_klet_table(tablename.c_str()));
+    ku = mc.k;
+    streaming = true;
+  }
+
+  if (!has_file && !streaming && isatty(STDIN_FILENO)) {
     cerr << "Error: missing input\n";
     cerr << "Run shuffler -h to see usage.\n";
     exit(EXIT_FAILURE);
@@ -298,6 +891,12 @@ int main(int argc, char **argv) {
     exit(EXIT_FAILURE);
   }
   n_repeats += n_repeatsu;
+  if (nthreadsu < 1) {
+    cerr << "Error: number of threads must be greater than 0\n";
+    cerr << "Run shuffler -h to see usage.\n";
+    exit(EXIT_FAILURE);
+  }
+  nthreads = nthreadsu;
 
   if (use_linear && use_markov) {
     cerr << "Error: only use one of -l and -m flags\n";
@@ -310,13 +909,22 @@ int main(int argc, char **argv) {
     else if (use_linear) method_i = 3;
     else method_i = 4;
   }
-
-  gen = default_random_engine(iseed);
+  if (streaming) method_i = 2;
 
   if (verbose) {
     cerr << "K-let size: " << k << '\n';
+    cerr << "RNG: ";
+    switch (rng) {
+      case RNG_XOSHIRO: cerr << "xoshiro256ss";
+                        break;
+      case RNG_PCG: cerr << "pcg64";
+                    break;
+      case RNG_MINSTD: cerr << "minstd";
+                       break;
+    }
+    cerr << '\n';
     cerr << "RNG seed: " << iseed << '\n';
-    if (k > 1) {
+    if (method_i > 1) {
       cerr << "Shuffling method: ";
       switch (method_i) {
         case 2: cerr << "markov";
@@ -330,77 +938,116 @@ int main(int argc, char **argv) {
     }
   }
 
-  if (!is_fasta) {
-
-    if (!has_file) {
-
-      letters = "";
-      while (cin >> l) letters += l;
-
-      if (letters.length() <= k) {
-        cerr << "Error: k must be greater than sequence length\n";
-        exit(EXIT_FAILURE);
-      }
+  if (has_file && is_twobit(filename.c_str())) {
+    seqfile.close();
+    tb = twobit_open(filename.c_str());
+    is_twobit_in = true;
+  }
 
-      if (has_out) {
-        shuffle_and_write(letters, k, gen, verbose, method_i, outfile, false, n_repeats);
-        outfile.close();
-      } else {
-        shuffle_and_write(letters, k, gen, verbose, method_i, cout, false, n_repeats);
-      }
+  /* markov shuffling only needs the k-let counts, so a sequence in a regular
+   * file is counted on a first pass instead of being read into memory
+   */
 
-      if (verbose) {
-        cerr << "Shuffled " << letters.length() << " characters\n";
-      }
+  if (method_i == 2 && has_file && !is_fasta && !is_twobit_in
+      && stat(filename.c_str(), &sb) == 0 && S_ISREG(sb.st_mode)) {
+    mc = count_markov(seqfile, k);
+    streaming = true;
+  }
 
-    } else {
+  if (streaming && mc.seqlen <= k) {
+    cerr << "Error: k must be greater than sequence length\n";
+    exit(EXIT_FAILURE);
+  }
 
-      letters = "";
-      while (seqfile >> l) letters += l;
-      seqfile.close();
+  if (mem_limit > 0 && (method_i != 1 && method_i != 3)) {
+    cerr << "Error: --mem only works with -k 1 or -l\n";
+    cerr << "Run shuffler -h to see usage.\n";
+    exit(EXIT_FAILURE);
+  }
 
-      if (letters.length() <= k) {
-        cerr << "Error: k must be greater than sequence length\n";
-        exit(EXIT_FAILURE);
-      }
+  if (mem_limit > 0 && (!has_file || is_fasta || is_twobit_in || !has_out
+        || tbout)) {
+    cerr << "Error: --mem needs non-fasta input given with -i and output with -o\n";
+    cerr << "Run shuffler -h to see usage.\n";
+    exit(EXIT_FAILURE);
+  }
 
-      if (has_out) {
-        shuffle_and_write(letters, k, gen, verbose, method_i, outfile, false, n_repeats);
-        outfile.close();
-      } else {
-        shuffle_and_write(letters, k, gen, verbose, method_i, cout, false, n_repeats);
-      }
+  if (shard_n > 0 && (!has_file || (!is_fasta && !is_twobit_in))) {
+    cerr << "Error: --shard needs a fasta or .2bit file given with -i\n";
+    cerr << "Run shuffler -h to see usage.\n";
+    exit(EXIT_FAILURE);
+  }
 
-      if (verbose) {
-        cerr << "Shuffled " << letters.length() << " characters\n";
-      }
+  /* shards are contiguous runs of records, so that their outputs concatenate
+   * to the output of a single run; fasta files are counted first
+   */
 
+  if (shard_n > 0) {
+    if (is_twobit_in) {
+      nrecords = tb.names.size();
+    } else {
+      nrecords = count_fasta_records(seqfile);
+      seqfile.clear();
+      seqfile.seekg(0);
     }
+    first = nrecords * (shard_i - 1) / shard_n;
+    last = nrecords * shard_i / shard_n;
+    if (verbose) {
+      cerr << "Shard " << shard_i << '/' << shard_n << ": records " << first + 1
+        << " to " << last << " of " << nrecords << '\n';
+    }
+  }
 
-  } else {
-
-    if (!has_file) {
-
-      if (has_out) {
-        read_fasta_then_shuffle_and_write(cin, outfile, k, gen, method_i, verbose, n_repeats);
-        outfile.close();
-      } else {
-        read_fasta_then_shuffle_and_write(cin, cout, k, gen, method_i, verbose, n_repeats);
-      }
-
-    } else {
+  /* sequences larger than memory are shuffled between mapped files */
+
+  if (mem_limit > 0) {
+    seqfile.close();
+    outfile.close();
+    switch (rng) {
+      case RNG_XOSHIRO: shuffle_files<xoshiro256ss>(filename.c_str(),
+                            outname.c_str(), k, iseed, n_repeats, mem_limit, verbose);
+                        break;
+      case RNG_PCG: shuffle_files<pcg64>(filename.c_str(), outname.c_str(), k,
+                        iseed, n_repeats, mem_limit, verbose);
+                    break;
+      case RNG_MINSTD: shuffle_files<default_random_engine>(filename.c_str(),
+                           outname.c_str(), k, iseed, n_repeats, mem_limit, verbose);
+                       break;
+    }
+    return 0;
+  }
 
-      if (has_out) {
-        read_fasta_then_shuffle_and_write(seqfile, outfile, k, gen, method_i, verbose, n_repeats);
-        seqfile.close();
-        outfile.close();
-      } else {
-        read_fasta_then_shuffle_and_write(seqfile, cout, k, gen, method_i, verbose, n_repeats);
-        seqfile.close();
-      }
+  istream &input = has_file ? seqfile : cin;
+  ostream &output = tbout ? tbstream : has_out ? outfile : cout;
+
+  /* the generator is fixed here, so the shuffling code is compiled for each */
+
+  const twobit_file *tbin = is_twobit_in ? &tb : NULL;
+  const markov_chain *chain = streaming ? &mc : NULL;
+
+  switch (rng) {
+    case RNG_XOSHIRO: shuffle_input<xoshiro256ss>(iseed, input, output, tbin, chain,
+                          is_fasta, k, method_i, verbose, n_repeats, nthreads,
+                          first, last);
+                      break;
+    case RNG_PCG: shuffle_input<pcg64>(iseed, input, output, tbin, chain,
+                      is_fasta, k, method_i, verbose, n_repeats, nthreads, first,
+                      last);
+                  break;
+    case RNG_MINSTD: shuffle_input<default_random_engine>(iseed, input, output, tbin,
+                         chain, is_fasta, k, method_i, verbose, n_repeats, nthreads,
+                         first, last);
+                     break;
+  }
 
-    }
+  if (is_twobit_in) twobit_close(tb);
+  else if (has_file) seqfile.close();
 
+  if (tbout) {
+    output.flush();
+    tbout->close();
+  } else if (has_out) {
+    outfile.close();
   }
 
   return 0;
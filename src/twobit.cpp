@@ -0,0 +1,507 @@
+/*
+ * Copyright (C) 2026 Benjamin Jean-Marie Tremblay
+ *
+ * This file is part of sequence-utils.
+ *
+ * sequence-utils is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * sequence-utils is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with sequence-utils.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <cctype>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "twobit.hpp"
+using namespace std;
+
+#define TWOBIT_MAGIC 0x1A412743
+#define TWOBIT_SWAPPED 0x4327411A
+#define DECODE_SIZE 1048576
+
+/* Packed bases are T, C, A, G from 0 to 3, with the first base of a byte in
+ * its two highest bits.
+ */
+static const char bases[] = "TCAG";
+
+static uint32_t swap32(uint32_t x) {
+  return (x >> 24) | ((x >> 8) & 0xFF00) | ((x << 8) & 0xFF0000) | (x << 24);
+}
+
+/* Sequential reads of the file headers, starting from any offset. */
+struct tb_reader {
+  int fd;
+  bool swap;
+  uint64_t offset;
+  vector<char> buf;
+  size_t i, n;
+  void get(void *dest, size_t len) {
+    char *d = (char *)dest;
+    ssize_t r;
+    while (len > 0) {
+      if (i == n) {
+        if (buf.empty()) buf.resize(65536);
+        r = pread(fd, buf.data(), buf.size(), offset);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) {
+          cerr << "Error: truncated .2bit file\n";
+          exit(EXIT_FAILURE);
+        }
+        offset += r;
+        i = 0;
+        n = r;
+      }
+      size_t m = min(len, n - i);
+      memcpy(d, buf.data() + i, m);
+      d += m;
+      i += m;
+      len -= m;
+    }
+  }
+  uint32_t get32() {
+    uint32_t x;
+    get(&x, 4);
+    return swap ? swap32(x) : x;
+  }
+  uint64_t get64() {
+    uint32_t lo = get32(), hi = get32();
+    if (swap) std::swap(lo, hi);
+    return ((uint64_t)hi << 32) | lo;
+  }
+};
+
+bool is_twobit(const char *filename) {
+
+  struct stat sb;
+  uint32_t magic{0};
+  int fd;
+  ssize_t n;
+
+  /* only regular files, so as not to eat into a pipe */
+
+  if (stat(filename, &sb) != 0 || !S_ISREG(sb.st_mode)) return false;
+  fd = open(filename, O_RDONLY);
+  if (fd < 0) return false;
+  n = pread(fd, &magic, 4, 0);
+  close(fd);
+
+  return n == 4 && (magic == TWOBIT_MAGIC || magic == TWOBIT_SWAPPED);
+
+}
+
+twobit_file twobit_open(const char *filename) {
+
+  twobit_file tb;
+  uint32_t magic, version, count;
+  unsigned char namelen;
+  char name[256];
+
+  tb.fd = open(filename, O_RDONLY);
+  if (tb.fd < 0) {
+    cerr << "Error: file not found\n";
+    exit(EXIT_FAILURE);
+  }
+  tb_reader in{tb.fd, false, 0, vector<char>(), 0, 0};
+
+  in.get(&magic, 4);
+  if (magic != TWOBIT_MAGIC && magic != TWOBIT_SWAPPED) {
+    cerr << "Error: not a .2bit file\n";
+    exit(EXIT_FAILURE);
+  }
+  tb.swap = in.swap = magic == TWOBIT_SWAPPED;
+  version = in.get32();
+  count = in.get32();
+  in.get32();
+  if (version > 1) {
+    cerr << "Error: unsupported .2bit version [" << version << "]\n";
+    exit(EXIT_FAILURE);
+  }
+
+  /* version 1 has 64-bit offsets, for files over 4 GB */
+
+  tb.names.reserve(count);
+  tb.offsets.reserve(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    in.get(&namelen, 1);
+    in.get(name, namelen);
+    tb.names.push_back(string(name, namelen));
+    tb.offsets.push_back(version == 1 ? in.get64() : in.get32());
+  }
+
+  return tb;
+
+}
+
+size_t twobit_find(const twobit_file &tb, const string &name) {
+
+  /* without a name, there must be only the one sequence to choose from */
+
+  if (name.empty()) {
+    if (tb.names.size() == 1) return 0;
+    cerr << "Error: .2bit file has " << tb.names.size()
+      << " sequences, a sequence name must be given\n";
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t i = 0; i < tb.names.size(); ++i) {
+    if (tb.names[i] == name) return i;
+  }
+
+  cerr << "Error: sequence not found in .2bit file [" << name << "]\n";
+  exit(EXIT_FAILURE);
+
+}
+
+string twobit_read(const twobit_file &tb, size_t record) {
+
+  twobit_buf seq(tb, record);
+  string letters(seq.size(), '\0');
+
+  if (seq.size() > 0) seq.sgetn(&letters[0], seq.size());
+
+  return letters;
+
+}
+
+void twobit_close(twobit_file &tb) {
+  close(tb.fd);
+  tb.fd = -1;
+}
+
+twobit_buf::twobit_buf(const twobit_file &tb, size_t record) : fd(tb.fd), pos(0) {
+
+  tb_reader in{tb.fd, tb.swap, tb.offsets[record], vector<char>(), 0, 0};
+  uint32_t count;
+
+  dnasize = in.get32();
+  count = in.get32();
+  nstarts.resize(count);
+  nsizes.resize(count);
+  for (uint32_t i = 0; i < count; ++i) nstarts[i] = in.get32();
+  for (uint32_t i = 0; i < count; ++i) nsizes[i] = in.get32();
+  count = in.get32();
+  mstarts.resize(count);
+  msizes.resize(count);
+  for (uint32_t i = 0; i < count; ++i) mstarts[i] = in.get32();
+  for (uint32_t i = 0; i < count; ++i) msizes[i] = in.get32();
+  in.get32();
+  packed = tb.offsets[record] + 16 + 8 * ((uint64_t)nstarts.size() + mstarts.size());
+
+  setg(NULL, NULL, NULL);
+
+}
+
+static void apply_blocks(const vector<uint32_t> &starts, const vector<uint32_t> &sizes,
+    uint64_t from, uint64_t to, char *out, bool mask) {
+
+  /* blocks are sorted by start, so only those overlapping [from, to) are
+   * visited
+   */
+
+  size_t i = upper_bound(starts.begin(), starts.end(), from) - starts.begin();
+  if (i > 0) --i;
+
+  for (; i < starts.size() && starts[i] < to; ++i) {
+    uint64_t b = max((uint64_t)starts[i], from);
+    uint64_t e = min((uint64_t)starts[i] + sizes[i], to);
+    for (uint64_t j = b; j < e; ++j) {
+      if (mask) out[j - from] = tolower(out[j - from]);
+      else out[j - from] = 'N';
+    }
+  }
+
+}
+
+twobit_buf::int_type twobit_buf::underflow() {
+
+  if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+  if (pos >= dnasize) return traits_type::eof();
+
+  uint64_t len = min((uint64_t)DECODE_SIZE, dnasize - pos);
+  uint64_t first = pos / 4, last = (pos + len + 3) / 4;
+  size_t nbytes = last - first, done{0};
+  ssize_t r;
+
+  raw.resize(nbytes);
+  buf.resize(nbytes * 4);
+  while (done < nbytes) {
+    r = pread(fd, raw.data() + done, nbytes - done, packed + first + done);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) {
+      cerr << "Error: truncated .2bit file\n";
+      exit(EXIT_FAILURE);
+    }
+    done += r;
+  }
+
+  for (size_t i = 0; i < nbytes; ++i) {
+    unsigned char b = raw[i];
+    buf[4 * i] = bases[b >> 6];
+    buf[4 * i + 1] = bases[(b >> 4) & 3];
+    buf[4 * i + 2] = bases[(b >> 2) & 3];
+    buf[4 * i + 3] = bases[b & 3];
+  }
+
+  char *start = buf.data() + pos % 4;
+  apply_blocks(nstarts, nsizes, pos, pos + len, start, false);
+  apply_blocks(mstarts, msizes, pos, pos + len, start, true);
+  setg(buf.data(), start, start + len);
+  pos += len;
+
+  return traits_type::to_int_type(*gptr());
+
+}
+
+twobit_buf::pos_type twobit_buf::seekoff(off_type off, ios_base::seekdir dir,
+    ios_base::openmode which) {
+
+  off_type cur = pos - (egptr() - gptr());
+
+  switch (dir) {
+    case ios_base::beg: return seekpos(off, which);
+    case ios_base::cur: return seekpos(cur + off, which);
+    case ios_base::end: return seekpos(dnasize + off, which);
+    default: return pos_type(off_type(-1));
+  }
+
+}
+
+twobit_buf::pos_type twobit_buf::seekpos(pos_type p, ios_base::openmode which) {
+
+  if (!(which & ios_base::in) || p < 0 || p > dnasize) return pos_type(off_type(-1));
+  pos = p;
+  setg(NULL, NULL, NULL);
+
+  return p;
+
+}
+
+twobit_writer::twobit_writer(const string &name) : filename(name), buf(65536),
+    at_line_start(true), in_name(false), in_record(false), in_n(false),
+    in_mask(false), name_done(false) {
+
+  size_t slash = filename.find_last_of('/');
+  basename = slash == string::npos ? filename : filename.substr(slash + 1);
+  if (basename.length() > 5 && basename.compare(basename.length() - 5, 5, ".2bit") == 0)
+    basename.erase(basename.length() - 5);
+
+  setp(buf.data(), buf.data() + buf.size());
+
+}
+
+void twobit_writer::end_record() {
+  in_record = in_n = in_mask = false;
+}
+
+void twobit_writer::add_base(char c) {
+
+  record &r = records.back();
+  unsigned char code;
+
+  switch (c) {
+    case 'T': case 't': code = 0;
+                        break;
+    case 'C': case 'c': code = 1;
+                        break;
+    case 'A': case 'a': code = 2;
+                        break;
+    case 'G': case 'g': code = 3;
+                        break;
+    default: code = 4;
+  }
+
+  if (code == 4) {
+    if (in_n) ++r.nsizes.back();
+    else {
+      r.nstarts.push_back(r.size);
+      r.nsizes.push_back(1);
+    }
+    in_n = true;
+    code = 0;
+  } else {
+    in_n = false;
+  }
+
+  if (islower((unsigned char)c)) {
+    if (in_mask) ++r.msizes.back();
+    else {
+      r.mstarts.push_back(r.size);
+      r.msizes.push_back(1);
+    }
+    in_mask = true;
+  } else {
+    in_mask = false;
+  }
+
+  if (r.size % 4 == 0) r.packed += '\0';
+  r.packed.back() |= code << (6 - 2 * (r.size % 4));
+  if (r.size == UINT32_MAX) {
+    cerr << "Error: sequence too long for .2bit [" << r.name << "]\n";
+    exit(EXIT_FAILURE);
+  }
+  ++r.size;
+
+}
+
+void twobit_writer::consume(const char *p, const char *end) {
+
+  for (; p < end; ++p) {
+    char c = *p;
+    if (in_name) {
+      /* everything after the first word is dropped, as in faToTwoBit */
+      if (c == '\n') {
+        in_name = false;
+        at_line_start = true;
+      } else if (!isspace((unsigned char)c)) {
+        if (!name_done) records.back().name += c;
+      } else if (!records.back().name.empty()) {
+        name_done = true;
+      }
+      continue;
+    }
+    if (c == '>' && at_line_start) {
+      end_record();
+      records.push_back(record());
+      records.back().size = 0;
+      in_name = in_record = true;
+      name_done = false;
+      continue;
+    }
+    if (c == '\n') {
+      /* lines before the first header are separate sequences */
+      if (in_record && records.back().name.empty()) end_record();
+      at_line_start = true;
+      continue;
+    }
+    at_line_start = false;
+    if (isspace((unsigned char)c)) continue;
+    if (!in_record) {
+      records.push_back(record());
+      records.back().size = 0;
+      in_record = true;
+    }
+    add_base(c);
+  }
+
+}
+
+twobit_writer::int_type twobit_writer::overflow(int_type c) {
+
+  consume(pbase(), pptr());
+  setp(buf.data(), buf.data() + buf.size());
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    char ch = traits_type::to_char_type(c);
+    consume(&ch, &ch + 1);
+  }
+
+  return traits_type::not_eof(c);
+
+}
+
+int twobit_writer::sync() {
+  consume(pbase(), pptr());
+  setp(buf.data(), buf.data() + buf.size());
+  return 0;
+}
+
+static void put32(string &out, uint32_t x) {
+  for (int i = 0; i < 4; ++i) out += (char)((x >> (8 * i)) & 0xFF);
+}
+
+void twobit_writer::close() {
+
+  unsigned int headerless{0};
+  uint64_t offset, total;
+  bool v1;
+  string head;
+  ofstream out;
+
+  sync();
+  end_record();
+
+  for (size_t i = 0; i < records.size(); ++i) {
+    record &r = records[i];
+    if (r.name.empty()) {
+      if (headerless == 0) r.name = basename;
+      else r.name = basename + '-' + to_string(headerless);
+      ++headerless;
+    }
+    if (r.name.length() > 255) {
+      cerr << "Error: sequence name too long for .2bit [" << r.name << "]\n";
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  /* index entries are 4 bytes longer in version 1 */
+
+  offset = 16;
+  total = 0;
+  for (size_t i = 0; i < records.size(); ++i) {
+    offset += 1 + records[i].name.length() + 4;
+    total += 16 + 8 * (records[i].nstarts.size() + records[i].mstarts.size())
+      + records[i].packed.length();
+  }
+  v1 = offset + 4 * records.size() + total > UINT32_MAX;
+  if (v1) offset += 4 * records.size();
+
+  put32(head, TWOBIT_MAGIC);
+  put32(head, v1 ? 1 : 0);
+  put32(head, records.size());
+  put32(head, 0);
+  for (size_t i = 0; i < records.size(); ++i) {
+    const record &r = records[i];
+    head += (char)r.name.length();
+    head += r.name;
+    put32(head, offset & 0xFFFFFFFF);
+    if (v1) put32(head, offset >> 32);
+    offset += 16 + 8 * (r.nstarts.size() + r.mstarts.size()) + r.packed.length();
+  }
+
+  out.open(filename, ios::binary);
+  if (!out.good()) {
+    cerr << "Error: could not create outfile\n";
+    exit(EXIT_FAILURE);
+  }
+  out.write(head.data(), head.length());
+
+  for (size_t i = 0; i < records.size(); ++i) {
+    const record &r = records[i];
+    head.clear();
+    put32(head, r.size);
+    put32(head, r.nstarts.size());
+    for (size_t j = 0; j < r.nstarts.size(); ++j) put32(head, r.nstarts[j]);
+    for (size_t j = 0; j < r.nsizes.size(); ++j) put32(head, r.nsizes[j]);
+    put32(head, r.mstarts.size());
+    for (size_t j = 0; j < r.mstarts.size(); ++j) put32(head, r.mstarts[j]);
+    for (size_t j = 0; j < r.msizes.size(); ++j) put32(head, r.msizes[j]);
+    put32(head, 0);
+    out.write(head.data(), head.length());
+    out.write(r.packed.data(), r.packed.length());
+  }
+
+  out.close();
+  if (out.fail()) {
+    cerr << "Error: could not write outfile\n";
+    exit(EXIT_FAILURE);
+  }
+  records.clear();
+
+}
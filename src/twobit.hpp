@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2026 Benjamin Jean-Marie Tremblay
+ *
+ * This file is part of sequence-utils.
+ *
+ * sequence-utils is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * sequence-utils is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with sequence-utils.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _TWOBIT_
+#define _TWOBIT_
+
+#include <vector>
+#include <string>
+#include <streambuf>
+#include <cstdint>
+
+/* UCSC .2bit files: four bases per byte, plus lists of N and soft-masked
+ * (lowercase) blocks for every sequence.
+ */
+
+bool is_twobit(const char *filename);
+
+struct twobit_file {
+  int fd;
+  bool swap;
+  std::vector<std::string> names;
+  std::vector<uint64_t> offsets;
+};
+
+twobit_file twobit_open(const char *filename);
+
+size_t twobit_find(const twobit_file &tb, const std::string &name);
+
+std::string twobit_read(const twobit_file &tb, size_t record);
+
+void twobit_close(twobit_file &tb);
+
+/* Reads a single sequence as a stream of characters, decoding only a block of
+ * the packed data at a time.
+ */
+class twobit_buf : public std::streambuf {
+  public:
+    twobit_buf(const twobit_file &tb, size_t record);
+    uint32_t size() const { return dnasize; }
+  protected:
+    int_type underflow();
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+        std::ios_base::openmode which);
+    pos_type seekpos(pos_type p, std::ios_base::openmode which);
+  private:
+    int fd;
+    uint32_t dnasize;
+    uint64_t packed, pos;
+    std::vector<uint32_t> nstarts, nsizes, mstarts, msizes;
+    std::vector<unsigned char> raw;
+    std::vector<char> buf;
+};
+
+/* Takes fasta text and writes it out as .2bit on close(). Lines written before
+ * the first fasta header are each taken as a sequence of their own, named after
+ * the output file.
+ */
+class twobit_writer : public std::streambuf {
+  public:
+    twobit_writer(const std::string &filename);
+    void close();
+  protected:
+    int_type overflow(int_type c);
+    int sync();
+  private:
+    struct record {
+      std::string name;
+      uint32_t size;
+      std::vector<uint32_t> nstarts, nsizes, mstarts, msizes;
+      std::string packed;
+    };
+    std::string filename, basename;
+    std::vector<record> records;
+    std::vector<char> buf;
+    bool at_line_start, in_name, in_record, in_n, in_mask, name_done;
+    void consume(const char *p, const char *end);
+    void add_base(char c);
+    void end_record();
+};
+
+#endif
@@ -0,0 +1,35 @@
+#!/bin/sh
+# Windows aggregated from the tiles of a smaller window must match the same
+# windows counted on their own, whichever order the window sizes are listed in.
+
+countwin=bin/countwin
+seq=example/sequence.txt
+fail=0
+
+check() {
+  all=$($countwin -i $seq -a ACGT -w $1 -s $2 -k $3)
+  for w in $(echo $1 | tr , ' '); do
+    s=$(echo "$1 $2" | awk -v w=$w '{
+      n = split($1, ws, ","); split($2, ss, ",")
+      for (i = 1; i <= n; ++i) if (ws[i] == w) print (ss[i] == "" ? ss[1] : ss[i])
+    }')
+    for k in $(echo $3 | tr , ' '); do
+      got=$(echo "$all" | awk -v w=$w -v k=$k 'NR > 1 && $1 == w && $3 == k {
+        print $4, $5, $6, $7 }')
+      want=$($countwin -i $seq -a ACGT -w $w -s $s -k $k | awk 'NR > 1 {
+        print $1, $2, $3, $4 }')
+      if [ "$got" != "$want" ]; then
+        echo "FAIL: -w $1 -s $2 -k $3 (window $w, k $k)"
+        fail=1
+      fi
+    done
+  done
+}
+
+check 1000,100 1000,100 1,2
+check 100,1000 100,1000 1,2
+check 1000,500,100 500,500,100 1,2
+check 1000,100 500,100 1,2,3
+
+[ $fail = 0 ] && echo "countwin aggregate windows: ok"
+exit $fail